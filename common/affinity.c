@@ -0,0 +1,294 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "affinity.h"
+
+typedef struct _cpu_place
+{
+    int cpu;
+    int package;
+    int core;
+    int core_rank;      // index of the core within its package
+    int smt_rank;       // index of the hardware thread within its core
+} cpu_place;
+
+static int sort_compact;
+
+// reads a single integer from a sysfs file, or returns fallback
+static int read_topology(int cpu, const char *name, int fallback)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        return fallback;
+    }
+    int value;
+    if (fscanf(f, "%d", &value) != 1)
+    {
+        value = fallback;
+    }
+    fclose(f);
+    return value;
+}
+
+static int compare_places(const void *a, const void *b)
+{
+    const cpu_place *pa = (const cpu_place *)a;
+    const cpu_place *pb = (const cpu_place *)b;
+    int ka[3], kb[3];
+    if (sort_compact)
+    {
+        ka[0] = pa->package; ka[1] = pa->core_rank; ka[2] = pa->smt_rank;
+        kb[0] = pb->package; kb[1] = pb->core_rank; kb[2] = pb->smt_rank;
+    }
+    else
+    {
+        ka[0] = pa->smt_rank; ka[1] = pa->core_rank; ka[2] = pa->package;
+        kb[0] = pb->smt_rank; kb[1] = pb->core_rank; kb[2] = pb->package;
+    }
+    for (int i=0; i<3; ++i)
+    {
+        if (ka[i] != kb[i])
+        {
+            return ka[i] < kb[i] ? -1 : 1;
+        }
+    }
+    return pa->cpu - pb->cpu;
+}
+
+static int by_cpu(const void *a, const void *b)
+{
+    const cpu_place *pa = (const cpu_place *)a;
+    const cpu_place *pb = (const cpu_place *)b;
+    if (pa->package != pb->package)
+    {
+        return pa->package - pb->package;
+    }
+    if (pa->core != pb->core)
+    {
+        return pa->core - pb->core;
+    }
+    return pa->cpu - pb->cpu;
+}
+
+// orders the CPUs this process may run on for the compact or scatter policy
+static int topology_order(affinity_policy *policy, int compact)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+    {
+        perror("sched_getaffinity");
+        exit(1);
+    }
+
+    int num = CPU_COUNT(&allowed);
+    cpu_place *places = (cpu_place *)malloc(num*sizeof(cpu_place));
+    policy->cpus = (int *)malloc(num*sizeof(int));
+    if (places == NULL || policy->cpus == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    int n = 0;
+    for (int cpu=0; cpu<CPU_SETSIZE && n<num; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &allowed))
+        {
+            places[n].cpu = cpu;
+            places[n].package = read_topology(cpu, "physical_package_id", 0);
+            places[n].core = read_topology(cpu, "core_id", cpu);
+            ++n;
+        }
+    }
+
+    // rank cores within each package and hardware threads within each core
+    qsort(places, n, sizeof(cpu_place), by_cpu);
+    for (int i=0; i<n; ++i)
+    {
+        if (i == 0 || places[i].package != places[i-1].package)
+        {
+            places[i].core_rank = 0;
+            places[i].smt_rank = 0;
+        }
+        else if (places[i].core != places[i-1].core)
+        {
+            places[i].core_rank = places[i-1].core_rank + 1;
+            places[i].smt_rank = 0;
+        }
+        else
+        {
+            places[i].core_rank = places[i-1].core_rank;
+            places[i].smt_rank = places[i-1].smt_rank + 1;
+        }
+    }
+
+    sort_compact = compact;
+    qsort(places, n, sizeof(cpu_place), compare_places);
+    for (int i=0; i<n; ++i)
+    {
+        policy->cpus[i] = places[i].cpu;
+    }
+    policy->num_cpus = n;
+
+    free(places);
+    return n > 0;
+}
+
+// parses "0,2,8-11"; every CPU must be one this process may run on
+static int parse_cpu_list(const char *arg, affinity_policy *policy)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+    {
+        perror("sched_getaffinity");
+        exit(1);
+    }
+
+    int capacity = 16;
+    policy->cpus = (int *)malloc(capacity*sizeof(int));
+    if (policy->cpus == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    policy->num_cpus = 0;
+
+    const char *p = arg;
+    while (*p != '\0')
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p)
+        {
+            return 0;
+        }
+        p = end;
+        if (*p == '-')
+        {
+            ++p;
+            last = strtol(p, &end, 10);
+            if (end == p)
+            {
+                return 0;
+            }
+            p = end;
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE)
+        {
+            return 0;
+        }
+
+        for (long cpu=first; cpu<=last; ++cpu)
+        {
+            if (!CPU_ISSET(cpu, &allowed))
+            {
+                return 0;
+            }
+            if (policy->num_cpus == capacity)
+            {
+                capacity *= 2;
+                policy->cpus = (int *)realloc(policy->cpus, capacity*sizeof(int));
+                if (policy->cpus == NULL)
+                {
+                    perror("realloc");
+                    exit(1);
+                }
+            }
+            policy->cpus[policy->num_cpus++] = (int)cpu;
+        }
+
+        if (*p == ',')
+        {
+            ++p;
+        }
+        else if (*p != '\0')
+        {
+            return 0;
+        }
+    }
+    return policy->num_cpus > 0;
+}
+
+int parse_affinity(const char *arg, affinity_policy *policy)
+{
+    policy->kind = AFFINITY_NONE;
+    policy->num_cpus = 0;
+    policy->cpus = NULL;
+
+    if (strcmp(arg, "none") == 0)
+    {
+        return 1;
+    }
+    if (strcmp(arg, "compact") == 0)
+    {
+        policy->kind = AFFINITY_COMPACT;
+        return topology_order(policy, 1);
+    }
+    if (strcmp(arg, "scatter") == 0)
+    {
+        policy->kind = AFFINITY_SCATTER;
+        return topology_order(policy, 0);
+    }
+    policy->kind = AFFINITY_LIST;
+    return parse_cpu_list(arg, policy);
+}
+
+int affinity_cpu(affinity_policy *policy, int worker)
+{
+    if (policy == NULL || policy->kind == AFFINITY_NONE)
+    {
+        return -1;
+    }
+    return policy->cpus[worker % policy->num_cpus];
+}
+
+void affinity_attr(pthread_attr_t *attr, affinity_policy *policy, int worker)
+{
+    if (pthread_attr_init(attr) != 0)
+    {
+        perror("pthread_attr_init");
+        exit(1);
+    }
+
+    int cpu = affinity_cpu(policy, worker);
+    if (cpu < 0)
+    {
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_attr_setaffinity_np(attr, sizeof(set), &set) != 0)
+    {
+        perror("pthread_attr_setaffinity_np");
+        exit(1);
+    }
+}
+
+void print_affinity(FILE *out, affinity_policy *policy)
+{
+    static const char *kind_names[] = { "none", "compact", "scatter", "list" };
+    fprintf(out, "affinity=%s", kind_names[policy->kind]);
+    for (int i=0; i<policy->num_cpus; ++i)
+    {
+        fprintf(out, "%c%d", i == 0 ? ' ' : ',', policy->cpus[i]);
+    }
+    fprintf(out, "\n");
+}
+
+void free_affinity(affinity_policy *policy)
+{
+    free(policy->cpus);
+    policy->cpus = NULL;
+    policy->num_cpus = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+// Where worker threads run.  "compact" fills one socket core by core before
+// moving to the next, "scatter" deals consecutive workers out across
+// sockets and cores, and a list such as "0,2,8-11" names the CPUs
+// explicitly.  Worker i runs on cpus[i % num_cpus].
+
+#define AFFINITY_NONE 0
+#define AFFINITY_COMPACT 1
+#define AFFINITY_SCATTER 2
+#define AFFINITY_LIST 3
+
+typedef struct _affinity_policy
+{
+    int kind;
+    int num_cpus;
+    int *cpus;
+} affinity_policy;
+
+// fills policy from a command line argument; returns 0 if it is malformed
+int parse_affinity(const char *arg, affinity_policy *policy);
+
+// the CPU for a worker, or -1 when workers are left to the scheduler
+int affinity_cpu(affinity_policy *policy, int worker);
+
+// initializes attr for creating a worker, pinned if the policy says so
+void affinity_attr(pthread_attr_t *attr, affinity_policy *policy, int worker);
+
+void print_affinity(FILE *out, affinity_policy *policy);
+void free_affinity(affinity_policy *policy);
+
+#endif
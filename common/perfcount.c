@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+
+#include "perfcount.h"
+
+static const char *event_names[PERF_NUM_EVENTS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "ctx_switches"
+};
+
+static uint64_t perf_time_usec()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+    {
+        perror("clock_gettime");
+        exit(1);
+    }
+    return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+#ifdef __linux__
+static int open_event(int event, int inherit)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.inherit = inherit;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (event)
+    {
+        case PERF_CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_L1D_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_LLC_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PERF_BRANCH_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PERF_CTX_SWITCHES:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+            break;
+    }
+
+    // counting kernel time needs more privilege; fall back to user only
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd == -1)
+    {
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    return fd;
+}
+#endif
+
+void perf_start(perf_counters *pc, int inherit)
+{
+    for (int i=0; i<PERF_NUM_EVENTS; ++i)
+    {
+#ifdef __linux__
+        pc->fds[i] = open_event(i, inherit);
+#else
+        pc->fds[i] = -1;
+#endif
+        pc->available[i] = pc->fds[i] != -1;
+        pc->values[i] = 0;
+    }
+
+#ifdef __linux__
+    for (int i=0; i<PERF_NUM_EVENTS; ++i)
+    {
+        if (pc->available[i])
+        {
+            ioctl(pc->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(pc->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+
+    pc->start_usec = perf_time_usec();
+}
+
+void perf_stop(perf_counters *pc)
+{
+    pc->elapsed_usec = perf_time_usec() - pc->start_usec;
+
+    for (int i=0; i<PERF_NUM_EVENTS; ++i)
+    {
+        if (!pc->available[i])
+        {
+            continue;
+        }
+#ifdef __linux__
+        ioctl(pc->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+#endif
+        // value, time enabled, time running; when more events are open
+        // than the PMU has counters the kernel time-slices them, so scale
+        // the count up to the whole region
+        uint64_t buf[3];
+        if (read(pc->fds[i], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0)
+        {
+            pc->available[i] = 0;
+        }
+        else
+        {
+            pc->values[i] = buf[2] < buf[1] ? (uint64_t)((double)buf[0]*buf[1]/buf[2]) : buf[0];
+        }
+        close(pc->fds[i]);
+        pc->fds[i] = -1;
+    }
+}
+
+// counts add up; elapsed time is the longest of the regions, as for
+// threads running side by side
+void perf_add(perf_counters *total, perf_counters *pc)
+{
+    for (int i=0; i<PERF_NUM_EVENTS; ++i)
+    {
+        total->values[i] += pc->values[i];
+        total->available[i] = total->available[i] && pc->available[i];
+    }
+    if (total->elapsed_usec < pc->elapsed_usec)
+    {
+        total->elapsed_usec = pc->elapsed_usec;
+    }
+}
+
+static void report_line(FILE *out, const char *label, const char *who, perf_counters *pc)
+{
+    fprintf(out, "%s %s:", label, who);
+    for (int i=0; i<PERF_NUM_EVENTS; ++i)
+    {
+        if (pc->available[i])
+        {
+            fprintf(out, " %s=%llu", event_names[i], (unsigned long long)pc->values[i]);
+        }
+        else
+        {
+            fprintf(out, " %s=n/a", event_names[i]);
+        }
+    }
+    if (pc->available[PERF_CYCLES] && pc->available[PERF_INSTRUCTIONS] && pc->values[PERF_CYCLES] > 0)
+    {
+        fprintf(out, " ipc=%.2lf", (double)pc->values[PERF_INSTRUCTIONS]/pc->values[PERF_CYCLES]);
+    }
+    fprintf(out, " time=%.6lfs\n", pc->elapsed_usec/1000000.0);
+}
+
+// one line per region, plus a total when there is more than one
+void perf_report(FILE *out, const char *label, perf_counters *pcs, int num)
+{
+    char who[32];
+    for (int i=0; i<num && num>1; ++i)
+    {
+        snprintf(who, sizeof(who), "thread %d", i);
+        report_line(out, label, who, &pcs[i]);
+    }
+
+    perf_counters total;
+    memset(&total, 0, sizeof(total));
+    for (int i=0; i<PERF_NUM_EVENTS; ++i)
+    {
+        total.available[i] = 1;
+    }
+    for (int i=0; i<num; ++i)
+    {
+        perf_add(&total, &pcs[i]);
+    }
+    report_line(out, label, "total", &total);
+}
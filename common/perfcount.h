@@ -0,0 +1,36 @@
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Hardware/software event counts for a timed region, read through
+// perf_event_open.  Events the kernel refuses (no PMU, perf_event_paranoid,
+// containers) are marked unavailable and the region is still timed, so
+// callers never need to check.
+
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1
+#define PERF_L1D_MISSES 2
+#define PERF_LLC_MISSES 3
+#define PERF_BRANCH_MISSES 4
+#define PERF_CTX_SWITCHES 5
+#define PERF_NUM_EVENTS 6
+
+typedef struct _perf_counters
+{
+    int fds[PERF_NUM_EVENTS];
+    int available[PERF_NUM_EVENTS];
+    uint64_t values[PERF_NUM_EVENTS];
+    uint64_t start_usec;
+    uint64_t elapsed_usec;
+} perf_counters;
+
+// count the calling thread from now on; with inherit set, threads it
+// creates afterwards are counted too once they have been joined
+void perf_start(perf_counters *pc, int inherit);
+void perf_stop(perf_counters *pc);
+void perf_add(perf_counters *total, perf_counters *pc);
+void perf_report(FILE *out, const char *label, perf_counters *pcs, int num);
+
+#endif
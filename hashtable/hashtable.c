@@ -189,10 +189,22 @@ hashtable *make_hashtable(int capacity)
     hash->capacity = capacity;
 
     hash->buckets = (hashbucket **)malloc(capacity*sizeof(hashbucket *));
+    hash->locks = (pthread_mutex_t *)malloc(capacity*sizeof(pthread_mutex_t));
+    if (hash->buckets == NULL || hash->locks == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
 
+    // one lock per bucket, owned by the table
     for (int i=0; i<capacity; ++i)
     {
         hash->buckets[i] = NULL;
+        if (pthread_mutex_init(&hash->locks[i], NULL) != 0)
+        {
+            printf("make_hashtable: lock init failed\n");
+            exit(1);
+        }
     }
 
     return hash;
@@ -275,8 +287,10 @@ void destroy_hashtable(hashtable *hash)
     for (int i=0; i<hash->capacity; ++i)
     {
         destroy_bucket(hash->buckets[i]);
+        pthread_mutex_destroy(&hash->locks[i]);
     }
 
     free(hash->buckets);
+    free(hash->locks);
     free(hash);
 }
@@ -23,14 +23,6 @@ typedef struct _hashtable
     pthread_mutex_t *locks;
 } hashtable;
 
-typedef struct _thread_args {
-  int id;
-  int t_num;
-  int k_num;
-  hashtable *hash;
-  char **keys;
-} thread_args;
-
 hashtable *make_hashtable(int capacity);
 void hashtable_insert(hashtable *hash, char *key, int value);
 hashitem *hashtable_search(hashtable *hash, char *key);
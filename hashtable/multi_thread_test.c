@@ -5,10 +5,22 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <libgen.h>
+#include <unistd.h>
 #include <time.h>
 #include <sys/time.h>
 #include <pthread.h>
 #include "hashtable.h"
+#include "perfcount.h"
+#include "affinity.h"
+
+typedef struct _thread_args {
+  int id;
+  int t_num;
+  int k_num;
+  hashtable *hash;
+  char **keys;
+  perf_counters *perf;
+} thread_args;
 
 uint64_t get_time_usec()
 {
@@ -60,6 +72,7 @@ char *random_key(int len)
 
 void *thread_insert(void *arg) {
   thread_args *targs = (thread_args *)arg;
+  perf_start(targs->perf, 0);
   
   int min_tasks_per_thread = targs->k_num / targs->t_num;
   int extra_tasks = targs->k_num % targs->t_num;
@@ -76,12 +89,14 @@ void *thread_insert(void *arg) {
       my_start_task += extra_tasks;
   }
 
-  insert_keys(targs->hash, targs->keys, my_num_tasks);
+  insert_keys(targs->hash, targs->keys + my_start_task, my_num_tasks);
+  perf_stop(targs->perf);
   pthread_exit(NULL);
 }
 
 void *thread_search(void *arg) {
   thread_args *targs = (thread_args *)arg;
+  perf_start(targs->perf, 0);
   
   int min_tasks_per_thread = targs->k_num / targs->t_num;
   int extra_tasks = targs->k_num % targs->t_num;
@@ -98,21 +113,46 @@ void *thread_search(void *arg) {
       my_start_task += extra_tasks;
   }
 
-  long lost = (long)search_keys(targs->hash, targs->keys, my_num_tasks);
+  long lost = (long)search_keys(targs->hash, targs->keys + my_start_task, my_num_tasks);
+  perf_stop(targs->perf);
   pthread_exit((void *)lost);
 }
 
+void usage(char *prog)
+{
+    printf("usage: %s [-a compact|scatter|cpu_list] num_threads\n", basename(prog));
+    exit(1);
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    // -a pins the worker threads to CPUs
+    affinity_policy affinity = { AFFINITY_NONE, 0, NULL };
+    int opt;
+    while ((opt = getopt(argc, argv, "a:")) != -1)
     {
-        printf("usage: %s\n", basename(argv[0]));
-        exit(1);
+        switch (opt)
+        {
+            case 'a':
+                if (!parse_affinity(optarg, &affinity))
+                {
+                    printf("error: invalid affinity %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 1)
+    {
+        usage(argv[0]);
     }
 
     srandom(time(NULL));
 
-    int num_t = atoi(argv[1]);
+    int num_t = atoi(argv[optind]);
     if (num_t < 1) {
       printf("Invalid number of threads\n");
       exit(1);
@@ -134,25 +174,16 @@ int main(int argc, char *argv[])
         keys[i] = random_key(key_len);;
     }
 
-    pthread_mutex_t *lock = (pthread_mutex_t *)malloc(num_keys * sizeof(pthread_mutex_t));
     pthread_t *threads = (pthread_t *)malloc(num_t * sizeof(pthread_t));
+    perf_counters *perfs = (perf_counters *)malloc(num_t * sizeof(perf_counters));
     
-    if (!threads) {
+    if (!threads || !perfs) {
       printf("pthreads error\n");
       exit(1);
     }
 
     hashtable *hash = make_hashtable(64);
 
-    for (int i = 0; i < key_len; ++i) {
-      if (pthread_mutex_init(&lock[i], NULL) != 0) {
-        printf("lock init failed\n");
-        exit(1);
-      }
-    }
-
-    hash->locks = lock;
-
     uint64_t start = get_time_usec();
     thread_args *targs = (thread_args *)malloc(num_t * sizeof(thread_args));
 
@@ -162,11 +193,15 @@ int main(int argc, char *argv[])
       targs[i].k_num = num_keys;
       targs[i].keys = keys;
       targs[i].hash = hash;
+      targs[i].perf = &perfs[i];
 
-      if (pthread_create(&threads[i], NULL, thread_insert, &targs[i]) != 0) {
+      pthread_attr_t attr;
+      affinity_attr(&attr, &affinity, i);
+      if (pthread_create(&threads[i], &attr, thread_insert, &targs[i]) != 0) {
         perror("pthread_create\n");
         exit(1);
       }
+      pthread_attr_destroy(&attr);
     }
 
     for (int i = 0; i < num_t; ++i) {
@@ -176,6 +211,7 @@ int main(int argc, char *argv[])
     uint64_t stop = get_time_usec();
     uint64_t total = stop-start;
     fprintf(stderr, "insert time=%.6lfs\n", total/1000000.0);
+    perf_report(stderr, "insert perf", perfs, num_t);
 
     start = get_time_usec();
 
@@ -185,25 +221,34 @@ int main(int argc, char *argv[])
       targs[i].k_num = num_keys;
       targs[i].keys = keys;
       targs[i].hash = hash;
+      targs[i].perf = &perfs[i];
     
-      if (pthread_create(&threads[i], NULL, thread_search, &targs[i]) != 0) {
+      pthread_attr_t attr;
+      affinity_attr(&attr, &affinity, i);
+      if (pthread_create(&threads[i], &attr, thread_search, &targs[i]) != 0) {
         perror("pthread_create");
         exit(1);
       }
+      pthread_attr_destroy(&attr);
     }
 
-    int* missing_keys = (int *)malloc(num_t * sizeof(int));
     int sum = 0;
 
     for (int i = 0; i < num_t; ++i) {
-      pthread_join(threads[i], (void **)&missing_keys[i]);
-      sum += missing_keys[i];
+      void *missing_keys;
+      pthread_join(threads[i], &missing_keys);
+      sum += (int)(long)missing_keys;
     }
 
     stop = get_time_usec();
     total = stop-start;
     fprintf(stderr, "Missing keys: %d\n", sum);
     fprintf(stderr, "search time=%.6lfs\n", total/1000000.0);
+    perf_report(stderr, "search perf", perfs, num_t);
+    if (affinity.kind != AFFINITY_NONE)
+    {
+        print_affinity(stderr, &affinity);
+    }
 
     for (int i=0; i<num_keys; ++i)
     {
@@ -213,6 +258,8 @@ int main(int argc, char *argv[])
     free(keys);
     free(threads);
     free(targs);
+    free(perfs);
+    free_affinity(&affinity);
     destroy_hashtable(hash);
 
     return 0;
@@ -0,0 +1,483 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "batch.h"
+#include "small_matmul.h"
+
+// Threads are started once per call, not once per product.  Arithmetic is
+// unsigned so overflow wraps like multiply_matrix does.
+
+typedef struct _batch_args
+{
+    int id;
+    int t_num;
+    matrix **a;
+    matrix **b;
+    matrix **c;
+    int *small;         // indices of products done whole by one thread
+    int num_small;
+    int *large;         // indices of products split by rows
+    int num_large;
+    int *next_small;
+    pthread_mutex_t *lock;
+} batch_args;
+
+// a chain operand is an input matrix (id >= 0) or a scratch buffer
+// (id = -1 - buffer number); the last step writes the result (dst = -1)
+typedef struct _chain_step
+{
+    int a_src;
+    int b_src;
+    int dst;
+    int rows;
+    int inner;
+    int cols;
+} chain_step;
+
+typedef struct _chain_plan
+{
+    matrix **ms;
+    int *split;
+    int count;
+    chain_step *steps;
+    int num_steps;
+    size_t *buf_size;
+    int *buf_busy;
+    int num_bufs;
+} chain_plan;
+
+typedef struct _chain_args
+{
+    int id;
+    int t_num;
+    chain_plan *plan;
+    int **bufs;
+    matrix *res;
+    pthread_barrier_t *barrier;
+} chain_args;
+
+// rows [first, last) of c = a * b on contiguous row-major arrays
+static void multiply_rows(const int *a, const int *b, int *c,
+                          int inner, int cols, int first, int last)
+{
+    for (int r=first; r<last; ++r)
+    {
+        unsigned *restrict c_row = (unsigned *)c + (size_t)r*cols;
+        memset(c_row, 0, cols*sizeof(unsigned));
+        for (int k=0; k<inner; ++k)
+        {
+            unsigned a_rk = (unsigned)a[(size_t)r*inner + k];
+            const unsigned *restrict b_row = (const unsigned *)b + (size_t)k*cols;
+            for (int j=0; j<cols; ++j)
+            {
+                c_row[j] += a_rk * b_row[j];
+            }
+        }
+    }
+}
+
+static void thread_rows(int id, int t_num, int num_rows, int *first, int *last)
+{
+    // divide rows as equally as possible across threads
+    int min_rows_per_thread = num_rows / t_num;
+    int extra_rows = num_rows % t_num;
+
+    *first = min_rows_per_thread * id;
+    int count = min_rows_per_thread;
+    if (extra_rows > id)
+    {
+        *first += id;
+        ++count;
+    }
+    else
+    {
+        *first += extra_rows;
+    }
+    *last = *first + count;
+}
+
+static void run_threads(void *(*fn)(void *), void *args, size_t arg_size, int num_threads)
+{
+    pthread_t *tids = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    if (tids == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int i=0; i<num_threads; ++i)
+    {
+        if (pthread_create(&tids[i], NULL, fn, (char *)args + i*arg_size) != 0)
+        {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (int i=0; i<num_threads; ++i)
+    {
+        if (pthread_join(tids[i], NULL) != 0)
+        {
+            perror("pthread_join");
+            exit(1);
+        }
+    }
+
+    free(tids);
+}
+
+static void *batch_main(void *arg)
+{
+    batch_args *targs = (batch_args *)arg;
+
+    // large products first, each split by rows; no barrier is needed since
+    // products are independent
+    for (int i=0; i<targs->num_large; ++i)
+    {
+        int p = targs->large[i];
+        int first, last;
+        thread_rows(targs->id, targs->t_num, targs->a[p]->num_rows, &first, &last);
+        multiply_rows(targs->a[p]->storage, targs->b[p]->storage, targs->c[p]->storage,
+                      targs->a[p]->num_cols, targs->b[p]->num_cols, first, last);
+    }
+
+    // then small products handed out one at a time to whichever thread is
+    // free, which also evens out any imbalance from above
+    while (1)
+    {
+        pthread_mutex_lock(targs->lock);
+        int i = (*targs->next_small)++;
+        pthread_mutex_unlock(targs->lock);
+        if (i >= targs->num_small)
+        {
+            break;
+        }
+
+        int p = targs->small[i];
+        if (!small_multiply(targs->a[p]->storage, targs->b[p]->storage, targs->c[p]->storage,
+                            targs->a[p]->num_rows, targs->a[p]->num_cols, targs->b[p]->num_cols))
+        {
+            multiply_rows(targs->a[p]->storage, targs->b[p]->storage, targs->c[p]->storage,
+                          targs->a[p]->num_cols, targs->b[p]->num_cols, 0, targs->a[p]->num_rows);
+        }
+    }
+
+    return NULL;
+}
+
+void multiply_batch(matrix **a, matrix **b, matrix **c, int count, int num_threads)
+{
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    int *small = (int *)malloc((count > 0 ? count : 1)*sizeof(int));
+    int *large = (int *)malloc((count > 0 ? count : 1)*sizeof(int));
+    if (small == NULL || large == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    int num_small = 0;
+    int num_large = 0;
+    for (int i=0; i<count; ++i)
+    {
+        if (a[i]->num_cols != b[i]->num_rows)
+        {
+            printf("Matrix dimensions don't match!");
+            exit(1);
+        }
+        if (c[i] == NULL)
+        {
+            c[i] = alloc_matrix(a[i]->num_rows, b[i]->num_cols);
+        }
+        else if (c[i]->num_rows != a[i]->num_rows || c[i]->num_cols != b[i]->num_cols)
+        {
+            printf("Result matrix has the wrong shape!");
+            exit(1);
+        }
+
+        double work = (double)a[i]->num_rows*a[i]->num_cols*b[i]->num_cols;
+        if (work < BATCH_SMALL_PRODUCT || num_threads == 1)
+        {
+            small[num_small++] = i;
+        }
+        else
+        {
+            large[num_large++] = i;
+        }
+    }
+
+    pthread_mutex_t lock;
+    if (pthread_mutex_init(&lock, NULL) != 0)
+    {
+        printf("lock init failed\n");
+        exit(1);
+    }
+    int next_small = 0;
+
+    batch_args *targs = (batch_args *)malloc(num_threads*sizeof(batch_args));
+    if (targs == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i=0; i<num_threads; ++i)
+    {
+        targs[i].id = i;
+        targs[i].t_num = num_threads;
+        targs[i].a = a;
+        targs[i].b = b;
+        targs[i].c = c;
+        targs[i].small = small;
+        targs[i].num_small = num_small;
+        targs[i].large = large;
+        targs[i].num_large = num_large;
+        targs[i].next_small = &next_small;
+        targs[i].lock = &lock;
+    }
+
+    run_threads(batch_main, targs, sizeof(batch_args), num_threads);
+
+    pthread_mutex_destroy(&lock);
+    free(targs);
+    free(small);
+    free(large);
+}
+
+// classic O(n^3) matrix-chain dynamic program; split[i*count+j] is where
+// the product of ms[i..j] is best divided
+static int *chain_order(matrix **ms, int count)
+{
+    double *cost = (double *)calloc((size_t)count*count, sizeof(double));
+    int *split = (int *)calloc((size_t)count*count, sizeof(int));
+    if (cost == NULL || split == NULL)
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    for (int len=2; len<=count; ++len)
+    {
+        for (int i=0; i+len-1<count; ++i)
+        {
+            int j = i+len-1;
+            cost[i*count+j] = -1;
+            for (int s=i; s<j; ++s)
+            {
+                double c = cost[i*count+s] + cost[(s+1)*count+j]
+                    + (double)ms[i]->num_rows*ms[s]->num_cols*ms[j]->num_cols;
+                if (cost[i*count+j] < 0 || c < cost[i*count+j])
+                {
+                    cost[i*count+j] = c;
+                    split[i*count+j] = s;
+                }
+            }
+        }
+    }
+
+    free(cost);
+    return split;
+}
+
+// reuse the smallest idle buffer that is big enough, else grow the largest
+// idle one, else add a buffer; sizes are final only once planning is done
+static int acquire_buffer(chain_plan *plan, size_t size)
+{
+    int best = -1;
+    for (int i=0; i<plan->num_bufs; ++i)
+    {
+        if (plan->buf_busy[i])
+        {
+            continue;
+        }
+        if (best < 0)
+        {
+            best = i;
+            continue;
+        }
+        int fits = plan->buf_size[i] >= size;
+        int best_fits = plan->buf_size[best] >= size;
+        if ((fits && (!best_fits || plan->buf_size[i] < plan->buf_size[best]))
+            || (!fits && !best_fits && plan->buf_size[i] > plan->buf_size[best]))
+        {
+            best = i;
+        }
+    }
+    if (best < 0)
+    {
+        best = plan->num_bufs++;
+        plan->buf_size[best] = 0;
+    }
+
+    if (plan->buf_size[best] < size)
+    {
+        plan->buf_size[best] = size;
+    }
+    plan->buf_busy[best] = 1;
+    return best;
+}
+
+static int plan_chain(chain_plan *plan, int i, int j, int is_result)
+{
+    if (i == j)
+    {
+        return i;
+    }
+
+    int s = plan->split[i*plan->count+j];
+    int left = plan_chain(plan, i, s, 0);
+    int right = plan_chain(plan, s+1, j, 0);
+
+    chain_step *step = &plan->steps[plan->num_steps++];
+    step->a_src = left;
+    step->b_src = right;
+    step->rows = plan->ms[i]->num_rows;
+    step->inner = plan->ms[s]->num_cols;
+    step->cols = plan->ms[j]->num_cols;
+
+    // the destination is taken before the sources are released so that a
+    // step never writes over its own inputs
+    int dst = is_result ? -1 : -1 - acquire_buffer(plan, (size_t)step->rows*step->cols);
+    step->dst = dst;
+    if (left < 0)
+    {
+        plan->buf_busy[-1 - left] = 0;
+    }
+    if (right < 0)
+    {
+        plan->buf_busy[-1 - right] = 0;
+    }
+
+    return dst;
+}
+
+static const int *chain_operand(chain_args *targs, int src)
+{
+    return src >= 0 ? targs->plan->ms[src]->storage : targs->bufs[-1 - src];
+}
+
+static void *chain_main(void *arg)
+{
+    chain_args *targs = (chain_args *)arg;
+    chain_plan *plan = targs->plan;
+
+    for (int s=0; s<plan->num_steps; ++s)
+    {
+        chain_step *step = &plan->steps[s];
+        int *dst = s == plan->num_steps-1 ? targs->res->storage : targs->bufs[-1 - step->dst];
+
+        int first, last;
+        thread_rows(targs->id, targs->t_num, step->rows, &first, &last);
+        multiply_rows(chain_operand(targs, step->a_src), chain_operand(targs, step->b_src),
+                      dst, step->inner, step->cols, first, last);
+
+        // every row of this step must be done before the next step reads it
+        pthread_barrier_wait(targs->barrier);
+    }
+
+    return NULL;
+}
+
+matrix *multiply_chain(matrix **ms, int count, int num_threads)
+{
+    if (count < 1)
+    {
+        printf("multiply_chain: need at least one matrix!\n");
+        exit(1);
+    }
+    for (int i=0; i+1<count; ++i)
+    {
+        if (ms[i]->num_cols != ms[i+1]->num_rows)
+        {
+            printf("Matrix dimensions don't match!");
+            exit(1);
+        }
+    }
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    matrix *res = alloc_matrix(ms[0]->num_rows, ms[count-1]->num_cols);
+    if (count == 1)
+    {
+        memcpy(res->storage, ms[0]->storage, (size_t)res->num_rows*res->num_cols*sizeof(int));
+        return res;
+    }
+
+    chain_plan plan;
+    plan.ms = ms;
+    plan.count = count;
+    plan.split = chain_order(ms, count);
+    plan.steps = (chain_step *)malloc((count-1)*sizeof(chain_step));
+    plan.num_steps = 0;
+    plan.buf_size = (size_t *)malloc(count*sizeof(size_t));
+    plan.buf_busy = (int *)calloc(count, sizeof(int));
+    plan.num_bufs = 0;
+    if (plan.steps == NULL || plan.buf_size == NULL || plan.buf_busy == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    plan_chain(&plan, 0, count-1, 1);
+
+    int **bufs = (int **)malloc((plan.num_bufs > 0 ? plan.num_bufs : 1)*sizeof(int *));
+    if (bufs == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i=0; i<plan.num_bufs; ++i)
+    {
+        bufs[i] = (int *)malloc(plan.buf_size[i]*sizeof(int));
+        if (bufs[i] == NULL)
+        {
+            perror("malloc");
+            exit(1);
+        }
+    }
+
+    pthread_barrier_t barrier;
+    if (pthread_barrier_init(&barrier, NULL, num_threads) != 0)
+    {
+        printf("barrier init failed\n");
+        exit(1);
+    }
+
+    chain_args *targs = (chain_args *)malloc(num_threads*sizeof(chain_args));
+    if (targs == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i=0; i<num_threads; ++i)
+    {
+        targs[i].id = i;
+        targs[i].t_num = num_threads;
+        targs[i].plan = &plan;
+        targs[i].bufs = bufs;
+        targs[i].res = res;
+        targs[i].barrier = &barrier;
+    }
+
+    run_threads(chain_main, targs, sizeof(chain_args), num_threads);
+
+    pthread_barrier_destroy(&barrier);
+    for (int i=0; i<plan.num_bufs; ++i)
+    {
+        free(bufs[i]);
+    }
+    free(bufs);
+    free(targs);
+    free(plan.split);
+    free(plan.steps);
+    free(plan.buf_size);
+    free(plan.buf_busy);
+    return res;
+}
@@ -0,0 +1,18 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "matrix.h"
+
+// products with fewer multiply-adds than this are spread across the batch,
+// one whole product per thread; larger ones are split by rows
+#define BATCH_SMALL_PRODUCT (64*64*64)
+
+// c[i] = a[i] * b[i] for every i.  c[i] may be a caller-provided matrix of
+// the right shape, whose storage is reused, or NULL to have one allocated.
+void multiply_batch(matrix **a, matrix **b, matrix **c, int count, int num_threads);
+
+// ms[0] * ms[1] * ... * ms[count-1], evaluated in the order that needs the
+// fewest multiply-adds, with intermediate results sharing a few buffers
+matrix *multiply_chain(matrix **ms, int count, int num_threads);
+
+#endif
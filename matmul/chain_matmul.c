@@ -0,0 +1,83 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <libgen.h>
+#include <time.h>
+#include <sys/time.h>
+#include "matrix.h"
+#include "parallel_io.h"
+#include "batch.h"
+
+uint64_t get_time_usec()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+    {
+        perror("clock_gettime");
+        exit(1);
+    }
+    return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        printf("usage: %s num_threads matrix1_file matrix2_file [matrix_file ...]\n", basename(argv[0]));
+        exit(1);
+    }
+
+    int num_t = atoi(argv[1]);
+    if (num_t < 1)
+    {
+        printf("error: must have at least one thread\n");
+        exit(1);
+    }
+
+    int count = argc-2;
+    matrix **ms = (matrix **)malloc(count*sizeof(matrix *));
+    if (ms == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    uint64_t read_start = get_time_usec();
+    for (int i=0; i<count; ++i)
+    {
+        ms[i] = read_matrix_parallel(argv[i+2], num_t);
+    }
+    uint64_t read_stop = get_time_usec();
+
+    for (int i=0; i+1<count; ++i)
+    {
+        if (ms[i]->num_cols != ms[i+1]->num_rows)
+        {
+            printf("Wrong Matrices!\n");
+            exit(1);
+        }
+    }
+
+    uint64_t start = get_time_usec();
+    matrix *res = multiply_chain(ms, count, num_t);
+    uint64_t stop = get_time_usec();
+
+    uint64_t write_start = get_time_usec();
+    print_matrix_parallel(res, num_t);
+    uint64_t write_stop = get_time_usec();
+
+    fprintf(stderr, "read time=%.6lfs\n", (read_stop-read_start)/1000000.0);
+    fprintf(stderr, "time=%.6lfs\n", (stop-start)/1000000.0);
+    fprintf(stderr, "write time=%.6lfs\n", (write_stop-write_start)/1000000.0);
+
+    for (int i=0; i<count; ++i)
+    {
+        free_matrix(ms[i]);
+    }
+    free(ms);
+    free_matrix(res);
+
+    return 0;
+}
@@ -0,0 +1,59 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include "typed_matrix.h"
+
+// converts between the text matrix format and the binary mmap format;
+// the input format is detected automatically.  Text input is parsed as
+// dtype (int32 by default), and a value that does not fit dtype is a
+// format error rather than being truncated; binary input must already be
+// of dtype if one is given.
+int main(int argc, char *argv[])
+{
+    if ((argc != 4 && argc != 5)
+        || (strcmp(argv[1], "text") != 0 && strcmp(argv[1], "binary") != 0))
+    {
+        printf("usage: %s text|binary input_file output_file [dtype]\n", basename(argv[0]));
+        exit(1);
+    }
+
+    uint32_t dtype = 0;
+    if (argc == 5)
+    {
+        dtype = dtype_from_name(argv[4]);
+        if (dtype == 0)
+        {
+            printf("error: unknown element type %s\n", argv[4]);
+            exit(1);
+        }
+    }
+
+    typed_matrix *m = read_typed_matrix(argv[2], dtype);
+
+    if (strcmp(argv[1], "binary") == 0)
+    {
+        write_typed_matrix_binary(m, argv[3]);
+    }
+    else
+    {
+        FILE *out = fopen(argv[3], "w");
+        if (out == NULL)
+        {
+            perror("fopen");
+            exit(1);
+        }
+        fprint_typed_matrix(out, m);
+        if (fclose(out) != 0)
+        {
+            perror("fclose");
+            exit(1);
+        }
+    }
+
+    free_typed_matrix(m);
+
+    return 0;
+}
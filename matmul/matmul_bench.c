@@ -0,0 +1,430 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <libgen.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include "matrix.h"
+#include "strassen.h"
+#include "sparse.h"
+#include "typed_matrix.h"
+#include "verify.h"
+
+#define MAX_LIST 64
+
+// how a kernel is run across the thread counts of the sweep
+#define SWEEP_NONE   0  // once, at the first thread count only
+#define SWEEP_ALL    1  // at every thread count
+#define SWEEP_SQUARE 2  // at every thread count for square shapes, else once
+
+typedef struct _bench_variant
+{
+    const char *name;
+    int sweep;
+    matrix *(*run)(matrix *m1, matrix *m2, int num_threads);
+} bench_variant;
+
+typedef struct _ikj_args
+{
+    int id;
+    int t_num;
+    matrix *m1;
+    matrix *m2;
+    matrix *m3;
+} ikj_args;
+
+typedef struct _bench_shape
+{
+    int m;
+    int k;
+    int n;
+} bench_shape;
+
+uint64_t get_time_usec()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+    {
+        perror("clock_gettime");
+        exit(1);
+    }
+    return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+matrix *run_reference(matrix *m1, matrix *m2, int num_threads)
+{
+    return multiply_matrix(m1, m2);
+}
+
+// the kernel of multi_thread_matmul: each thread runs gemm on one block
+// of rows
+void *ikj_main(void *arg)
+{
+    ikj_args *targs = (ikj_args *)arg;
+
+    // divide rows as equally as possible across threads
+    int min_rows_per_thread = targs->m1->num_rows / targs->t_num;
+    int extra_rows = targs->m1->num_rows % targs->t_num;
+
+    int my_first_row = min_rows_per_thread * targs->id;
+    int my_num_rows = min_rows_per_thread;
+    if (extra_rows > targs->id)
+    {
+        my_first_row += targs->id;
+        ++my_num_rows;
+    }
+    else
+    {
+        my_first_row += extra_rows;
+    }
+
+    if (my_num_rows > 0)
+    {
+        matrix a_rows = { targs->m1->data + my_first_row, my_num_rows, targs->m1->num_cols,
+                          targs->m1->data[my_first_row], NULL, 0 };
+        matrix c_rows = { targs->m3->data + my_first_row, my_num_rows, targs->m3->num_cols,
+                          targs->m3->data[my_first_row], NULL, 0 };
+        gemm(GEMM_NO_TRANS, GEMM_NO_TRANS, 1, &a_rows, targs->m2, 0, &c_rows);
+    }
+
+    return NULL;
+}
+
+matrix *run_ikj(matrix *m1, matrix *m2, int num_threads)
+{
+    matrix *res = alloc_matrix(m1->num_rows, m2->num_cols);
+    ikj_args *targs = (ikj_args *)malloc(num_threads*sizeof(ikj_args));
+    pthread_t *tids = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    if (targs == NULL || tids == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int i=0; i<num_threads; ++i)
+    {
+        targs[i].id = i;
+        targs[i].t_num = num_threads;
+        targs[i].m1 = m1;
+        targs[i].m2 = m2;
+        targs[i].m3 = res;
+
+        if (pthread_create(&tids[i], NULL, ikj_main, &targs[i]) != 0)
+        {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (int i=0; i<num_threads; ++i)
+    {
+        if (pthread_join(tids[i], NULL) != 0)
+        {
+            perror("pthread_join");
+            exit(1);
+        }
+    }
+
+    free(targs);
+    free(tids);
+    return res;
+}
+
+matrix *run_strassen(matrix *m1, matrix *m2, int num_threads)
+{
+    return strassen_multiply_matrix(m1, m2, STRASSEN_DEFAULT_CUTOFF, num_threads);
+}
+
+matrix *run_typed(matrix *m1, matrix *m2, int num_threads)
+{
+    // int32 views of the operands; no copies are made going in
+    typed_matrix t1 = { MATRIX_DTYPE_INT32, m1->num_rows, m1->num_cols, m1->storage, NULL, 0 };
+    typed_matrix t2 = { MATRIX_DTYPE_INT32, m2->num_rows, m2->num_cols, m2->storage, NULL, 0 };
+    typed_matrix *tres = typed_multiply(&t1, &t2, num_threads);
+
+    matrix *res = alloc_matrix(tres->num_rows, tres->num_cols);
+    memcpy(res->storage, tres->data, (size_t)res->num_rows*res->num_cols*sizeof(int));
+    free_typed_matrix(tres);
+    return res;
+}
+
+matrix *run_sparse(matrix *m1, matrix *m2, int num_threads)
+{
+    sparse_matrix *s1 = sparse_from_dense(m1, SPARSE_CSR);
+    matrix *res = sparse_dense_multiply(s1, m2, num_threads);
+    free_sparse_matrix(s1);
+    return res;
+}
+
+static bench_variant all_variants[] = {
+    { "reference", SWEEP_NONE,   run_reference },
+    { "ikj",       SWEEP_ALL,    run_ikj },
+    // only square products take the threaded recursion; others run the
+    // single-threaded blocked kernel, so sweeping them measures nothing
+    { "strassen",  SWEEP_SQUARE, run_strassen },
+    { "typed",     SWEEP_ALL,    run_typed },
+    { "sparse",    SWEEP_ALL,    run_sparse },
+};
+
+#define NUM_VARIANTS ((int)(sizeof(all_variants)/sizeof(all_variants[0])))
+
+void usage(char *prog)
+{
+    printf("usage: %s [-s MxKxN[,...]] [-t threads[,...]] [-k kernel[,...]]"
+           " [-r repeats] [-w warmups] [-d density] [-S seed] [-f rounds] [-V]\n", basename(prog));
+    printf("kernels:");
+    for (int i=0; i<NUM_VARIANTS; ++i)
+    {
+        printf(" %s", all_variants[i].name);
+    }
+    printf("\n");
+    exit(1);
+}
+
+// fills m with values in [-100, 100], each non-zero with probability density
+void random_matrix(matrix *m, double density)
+{
+    for (size_t i=0; i<(size_t)m->num_rows*m->num_cols; ++i)
+    {
+        int nonzero = density >= 1.0 || random() < density*RAND_MAX;
+        m->storage[i] = nonzero ? (int)(random() % 201) - 100 : 0;
+    }
+}
+
+int parse_shapes(char *arg, bench_shape *shapes)
+{
+    int count = 0;
+    for (char *tok=strtok(arg, ","); tok != NULL; tok=strtok(NULL, ","))
+    {
+        bench_shape *s = &shapes[count];
+        if (count == MAX_LIST || sscanf(tok, "%dx%dx%d", &s->m, &s->k, &s->n) != 3
+            || s->m < 1 || s->k < 1 || s->n < 1)
+        {
+            return 0;
+        }
+        ++count;
+    }
+    return count;
+}
+
+int parse_threads(char *arg, int *threads)
+{
+    int count = 0;
+    for (char *tok=strtok(arg, ","); tok != NULL; tok=strtok(NULL, ","))
+    {
+        if (count == MAX_LIST || (threads[count] = atoi(tok)) < 1)
+        {
+            return 0;
+        }
+        ++count;
+    }
+    return count;
+}
+
+int parse_variants(char *arg, bench_variant **variants)
+{
+    int count = 0;
+    for (char *tok=strtok(arg, ","); tok != NULL; tok=strtok(NULL, ","))
+    {
+        int found = 0;
+        for (int i=0; i<NUM_VARIANTS && !found; ++i)
+        {
+            if (strcmp(all_variants[i].name, tok) == 0)
+            {
+                if (count == MAX_LIST)
+                {
+                    return 0;
+                }
+                variants[count++] = &all_variants[i];
+                found = 1;
+            }
+        }
+        if (!found)
+        {
+            return 0;
+        }
+    }
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    bench_shape shapes[MAX_LIST] = { { 256, 256, 256 } };
+    int num_shapes = 1;
+    int threads[MAX_LIST] = { 1, 2, 4 };
+    int num_threads = 3;
+    bench_variant *variants[MAX_LIST];
+    int num_variants = 0;
+    int repeats = 5;
+    int warmups = 1;
+    double density = 1.0;
+    unsigned seed = 1;
+    int verify = 1;
+    int verify_rounds = FREIVALDS_DEFAULT_ROUNDS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:t:k:r:w:d:S:f:V")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                if ((num_shapes = parse_shapes(optarg, shapes)) == 0)
+                {
+                    usage(argv[0]);
+                }
+                break;
+            case 't':
+                if ((num_threads = parse_threads(optarg, threads)) == 0)
+                {
+                    usage(argv[0]);
+                }
+                break;
+            case 'k':
+                if ((num_variants = parse_variants(optarg, variants)) == 0)
+                {
+                    usage(argv[0]);
+                }
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            case 'w':
+                warmups = atoi(optarg);
+                break;
+            case 'd':
+                density = atof(optarg);
+                break;
+            case 'S':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'f':
+                verify_rounds = atoi(optarg);
+                break;
+            case 'V':
+                verify = 0;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc || repeats < 1 || warmups < 0 || density <= 0 || density > 1
+        || verify_rounds < 0)
+    {
+        usage(argv[0]);
+    }
+    if (num_variants == 0)
+    {
+        for (int i=1; i<NUM_VARIANTS; ++i)
+        {
+            variants[num_variants++] = &all_variants[i];
+        }
+    }
+
+    srandom(seed);
+    double *times = (double *)malloc(repeats*sizeof(double));
+    if (times == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    printf("m,k,n,kernel,threads,repeats,mean_s,min_s,stddev_s,gops,speedup,efficiency,verified\n");
+
+    for (int s=0; s<num_shapes; ++s)
+    {
+        bench_shape *sh = &shapes[s];
+        matrix *m1 = alloc_matrix(sh->m, sh->k);
+        matrix *m2 = alloc_matrix(sh->k, sh->n);
+        random_matrix(m1, density);
+        random_matrix(m2, density);
+
+        // results are checked with Freivalds' test, which costs O(n^2) per
+        // round; -f 0 compares against a full reference product instead
+        matrix *expected = verify && verify_rounds == 0 ? multiply_matrix(m1, m2) : NULL;
+        double ops = 2.0*sh->m*sh->k*sh->n;
+
+        for (int v=0; v<num_variants; ++v)
+        {
+            bench_variant *var = variants[v];
+            double base_time = 0;
+            int base_threads = 0;
+            int square = sh->m == sh->k && sh->k == sh->n;
+            int sweep = var->sweep == SWEEP_ALL || (var->sweep == SWEEP_SQUARE && square);
+
+            for (int t=0; t<(sweep ? num_threads : 1); ++t)
+            {
+                int nt = threads[t];
+
+                for (int w=0; w<warmups; ++w)
+                {
+                    free_matrix(var->run(m1, m2, nt));
+                }
+
+                const char *verified = "skipped";
+                for (int r=0; r<repeats; ++r)
+                {
+                    uint64_t start = get_time_usec();
+                    matrix *res = var->run(m1, m2, nt);
+                    uint64_t stop = get_time_usec();
+                    times[r] = (stop-start)/1000000.0;
+
+                    if (verify && r == 0 && expected != NULL)
+                    {
+                        size_t bytes = (size_t)sh->m*sh->n*sizeof(int);
+                        verified = memcmp(res->storage, expected->storage, bytes) == 0 ? "yes" : "NO";
+                    }
+                    else if (verify && r == 0)
+                    {
+                        verified = freivalds_verify(m1, m2, res, verify_rounds, nt, seed) ? "yes" : "NO";
+                    }
+                    free_matrix(res);
+                }
+
+                double sum = 0, min = times[0];
+                for (int r=0; r<repeats; ++r)
+                {
+                    sum += times[r];
+                    min = times[r] < min ? times[r] : min;
+                }
+                double mean = sum/repeats;
+                double var_sum = 0;
+                for (int r=0; r<repeats; ++r)
+                {
+                    var_sum += (times[r]-mean)*(times[r]-mean);
+                }
+                double stddev = repeats > 1 ? sqrt(var_sum/(repeats-1)) : 0;
+
+                // speedup and efficiency are relative to this kernel at the
+                // first thread count in the sweep
+                if (t == 0)
+                {
+                    base_time = mean;
+                    base_threads = nt;
+                }
+                double speedup = base_time/mean;
+                double efficiency = speedup*base_threads/nt;
+
+                printf("%d,%d,%d,%s,%d,%d,%.6lf,%.6lf,%.6lf,%.3lf,%.3lf,%.3lf,%s\n",
+                       sh->m, sh->k, sh->n, var->name, nt, repeats, mean, min, stddev,
+                       ops/mean/1e9, speedup, efficiency, verified);
+                fflush(stdout);
+            }
+        }
+
+        if (expected != NULL)
+        {
+            free_matrix(expected);
+        }
+        free_matrix(m1);
+        free_matrix(m2);
+    }
+
+    free(times);
+    return 0;
+}
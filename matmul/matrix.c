@@ -1,8 +1,31 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
- 
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "matrix.h"
 
+// point each row pointer at its slice of m->storage
+static void set_row_pointers(matrix *m)
+{
+    m->data = (int **)malloc(m->num_rows*sizeof(int *));
+    if (m->data == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    for (int r=0; r<m->num_rows; ++r)
+    {
+        m->data[r] = m->storage + (size_t)r*m->num_cols;
+    }
+}
+
 matrix *alloc_matrix(int rows, int cols)
 {
     matrix *m = (matrix *)malloc(sizeof(matrix));
@@ -14,27 +37,30 @@ matrix *alloc_matrix(int rows, int cols)
 
     m->num_rows = rows;
     m->num_cols = cols;
+    m->map = NULL;
+    m->map_len = 0;
 
-    m->data = (int **)malloc(m->num_rows*sizeof(int *));
-    if (m->data == NULL)
+    m->storage = (int *)malloc((size_t)rows*cols*sizeof(int));
+    if (m->storage == NULL)
     {
         perror("malloc");
         exit(1);
     }
-    for (int r=0; r<m->num_rows; ++r)
-    {
-        m->data[r] = (int *)malloc(m->num_cols*sizeof(int));
-        if (m->data[r] == NULL)
-        {
-          perror("malloc");
-          exit(1);
-        }
-    }
+    set_row_pointers(m);
 
     return m;
 }
 
 matrix *read_matrix(char *fname)
+{
+    if (is_binary_matrix_file(fname))
+    {
+        return map_matrix(fname);
+    }
+    return read_matrix_text(fname);
+}
+
+matrix *read_matrix_text(char *fname)
 {
     FILE *mfile = fopen(fname, "r");
     if (mfile == NULL)
@@ -73,35 +99,283 @@ matrix *read_matrix(char *fname)
             }
         }
     }
+    fclose(mfile);
     return m;
 }
 
-matrix *multiply_matrix(matrix *m1, matrix *m2)
+int is_binary_matrix_file(char *fname)
 {
-    if (m1->num_cols != m2->num_rows)
+    FILE *mfile = fopen(fname, "rb");
+    if (mfile == NULL)
     {
-        printf("Matrix dimensions don't match!");
+        perror("fopen");
         exit(1);
     }
 
-    matrix *res = alloc_matrix(m1->num_rows, m2->num_cols);
+    char magic[4];
+    int binary = fread(magic, 1, sizeof(magic), mfile) == sizeof(magic)
+        && memcmp(magic, MATRIX_BIN_MAGIC, sizeof(magic)) == 0;
+
+    fclose(mfile);
+    return binary;
+}
+
+size_t dtype_size(uint32_t dtype)
+{
+    switch (dtype)
+    {
+        case MATRIX_DTYPE_INT8:
+            return 1;
+        case MATRIX_DTYPE_INT16:
+            return 2;
+        case MATRIX_DTYPE_INT32:
+        case MATRIX_DTYPE_FLOAT:
+            return 4;
+        case MATRIX_DTYPE_INT64:
+        case MATRIX_DTYPE_DOUBLE:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+void init_matrix_bin_header(matrix_bin_header *hdr, uint32_t dtype, int rows, int cols)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, MATRIX_BIN_MAGIC, sizeof(hdr->magic));
+    hdr->version = MATRIX_BIN_VERSION;
+    hdr->dtype = dtype;
+    hdr->alignment = MATRIX_BIN_ALIGNMENT;
+    hdr->num_rows = rows;
+    hdr->num_cols = cols;
+    hdr->data_offset = (sizeof(*hdr) + MATRIX_BIN_ALIGNMENT - 1)
+        / MATRIX_BIN_ALIGNMENT * MATRIX_BIN_ALIGNMENT;
+}
+
+// exits with a message unless hdr describes a matrix that fits in a file
+// of file_len bytes
+void check_matrix_bin_header(matrix_bin_header *hdr, size_t file_len, char *fname)
+{
+    if (memcmp(hdr->magic, MATRIX_BIN_MAGIC, sizeof(hdr->magic)) != 0
+        || hdr->version != MATRIX_BIN_VERSION)
+    {
+        printf("Format error in %s\n", fname);
+        exit(1);
+    }
+    size_t elem_size = dtype_size(hdr->dtype);
+    if (elem_size == 0)
+    {
+        printf("Unsupported element type in %s\n", fname);
+        exit(1);
+    }
+    if (hdr->num_rows < 1 || hdr->num_rows > INT_MAX)
+    {
+        printf("Row value error in %s\n", fname);
+        exit(1);
+    }
+    if (hdr->num_cols < 1 || hdr->num_cols > INT_MAX)
+    {
+        printf("Column value error in %s\n", fname);
+        exit(1);
+    }
+    if (hdr->data_offset % elem_size != 0
+        || hdr->data_offset > file_len
+        || (file_len - hdr->data_offset)/elem_size/hdr->num_cols < hdr->num_rows)
+    {
+        printf("Format error in %s\n", fname);
+        exit(1);
+    }
+}
+
+void *map_matrix_file(char *fname, size_t *map_len)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1)
+    {
+        perror("open");
+        exit(1);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        perror("fstat");
+        exit(1);
+    }
+    size_t len = st.st_size;
+    if (len < sizeof(matrix_bin_header))
+    {
+        printf("Format error in %s\n", fname);
+        exit(1);
+    }
+
+    // private mapping: callers may write to the matrix without touching
+    // the file, and untouched pages are never copied
+    void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+    close(fd);
+
+    check_matrix_bin_header((matrix_bin_header *)map, len, fname);
+
+    *map_len = len;
+    return map;
+}
+
+matrix *map_matrix(char *fname)
+{
+    size_t len;
+    void *map = map_matrix_file(fname, &len);
+    matrix_bin_header *hdr = (matrix_bin_header *)map;
+    if (hdr->dtype != MATRIX_DTYPE_INT32)
+    {
+        printf("Unsupported element type in %s\n", fname);
+        exit(1);
+    }
+
+    matrix *m = (matrix *)malloc(sizeof(matrix));
+    if (m == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    m->num_rows = hdr->num_rows;
+    m->num_cols = hdr->num_cols;
+    m->storage = (int *)((char *)map + hdr->data_offset);
+    m->map = map;
+    m->map_len = len;
+    set_row_pointers(m);
+
+    return m;
+}
+
+void write_matrix_file(char *fname, uint32_t dtype, int rows, int cols, const void *elems)
+{
+    FILE *mfile = fopen(fname, "wb");
+    if (mfile == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    matrix_bin_header hdr;
+    init_matrix_bin_header(&hdr, dtype, rows, cols);
+
+    char pad[MATRIX_BIN_ALIGNMENT] = {0};
+    size_t num_elems = (size_t)rows*cols;
+    if (fwrite(&hdr, sizeof(hdr), 1, mfile) != 1
+        || fwrite(pad, 1, hdr.data_offset - sizeof(hdr), mfile) != hdr.data_offset - sizeof(hdr)
+        || fwrite(elems, dtype_size(dtype), num_elems, mfile) != num_elems)
+    {
+        perror("fwrite");
+        exit(1);
+    }
+
+    if (fclose(mfile) != 0)
+    {
+        perror("fclose");
+        exit(1);
+    }
+}
 
-    for (int r=0; r<res->num_rows; ++r)
+void write_matrix_binary(matrix *m, char *fname)
+{
+    write_matrix_file(fname, MATRIX_DTYPE_INT32, m->num_rows, m->num_cols, m->storage);
+}
+
+// the arithmetic is unsigned so that overflow wraps, which makes scaling
+// by alpha after summing give the same bits as scaling every term
+void gemm(int trans_a, int trans_b, int alpha, matrix *a, matrix *b, int beta, matrix *c)
+{
+    int rows = trans_a ? a->num_cols : a->num_rows;
+    int inner = trans_a ? a->num_rows : a->num_cols;
+    int b_inner = trans_b ? b->num_cols : b->num_rows;
+    int cols = trans_b ? b->num_rows : b->num_cols;
+    if (inner != b_inner || c->num_rows != rows || c->num_cols != cols)
+    {
+        printf("gemm: matrix dimensions don't match!\n");
+        exit(1);
+    }
+
+    for (int r=0; r<rows; ++r)
     {
-        for (int c=0; c<res->num_cols; ++c)
+        unsigned *restrict c_row = (unsigned *)c->data[r];
+        if (beta == 0)
+        {
+            memset(c_row, 0, cols*sizeof(unsigned));
+        }
+        else if (beta != 1)
         {
-            res->data[r][c] = 0;
-            for (int k=0; k<m1->num_cols; ++k)
+            for (int j=0; j<cols; ++j)
             {
-                res->data[r][c] += m1->data[r][k] * m2->data[k][c];
+                c_row[j] *= (unsigned)beta;
             }
         }
+        if (alpha == 0)
+        {
+            continue;
+        }
+
+        if (!trans_b)
+        {
+            // row r of c accumulates rows of b, scaled by op(a)[r][k]
+            for (int k=0; k<inner; ++k)
+            {
+                unsigned a_rk = (unsigned)alpha * (unsigned)(trans_a ? a->data[k][r] : a->data[r][k]);
+                const unsigned *restrict b_row = (const unsigned *)b->data[k];
+                for (int j=0; j<cols; ++j)
+                {
+                    c_row[j] += a_rk * b_row[j];
+                }
+            }
+        }
+        else
+        {
+            // op(b)[k][j] is b[j][k], so each element is a dot product with
+            // a contiguous row of b
+            for (int j=0; j<cols; ++j)
+            {
+                const unsigned *restrict b_row = (const unsigned *)b->data[j];
+                unsigned sum = 0;
+                if (!trans_a)
+                {
+                    const unsigned *restrict a_row = (const unsigned *)a->data[r];
+                    for (int k=0; k<inner; ++k)
+                    {
+                        sum += a_row[k] * b_row[k];
+                    }
+                }
+                else
+                {
+                    for (int k=0; k<inner; ++k)
+                    {
+                        sum += (unsigned)a->data[k][r] * b_row[k];
+                    }
+                }
+                c_row[j] += (unsigned)alpha * sum;
+            }
+        }
+    }
+}
+
+matrix *multiply_matrix(matrix *m1, matrix *m2)
+{
+    if (m1->num_cols != m2->num_rows)
+    {
+        printf("Matrix dimensions don't match!");
+        exit(1);
     }
 
+    matrix *res = alloc_matrix(m1->num_rows, m2->num_cols);
+    gemm(GEMM_NO_TRANS, GEMM_NO_TRANS, 1, m1, m2, 0, res);
     return res;
 }
 
-void print_matrix(matrix *m)
+void fprint_matrix(FILE *out, matrix *m)
 {
     int max = m->data[0][0];
     int min = m->data[0][0];
@@ -123,22 +397,31 @@ void print_matrix(matrix *m)
     int min_len = snprintf(NULL, 0, "%d", min);
     int longest = max_len>min_len ? max_len : min_len;
 
-    printf("%d\n%d\n", m->num_rows, m->num_cols);
+    fprintf(out, "%d\n%d\n", m->num_rows, m->num_cols);
     for (int r=0; r<m->num_rows; ++r)
     {
         for (int c=0; c<m->num_cols; ++c)
         {
-            printf("%*d", longest+1, m->data[r][c]);
+            fprintf(out, "%*d", longest+1, m->data[r][c]);
         }
-        printf("\n");
+        fprintf(out, "\n");
     }
 }
 
+void print_matrix(matrix *m)
+{
+    fprint_matrix(stdout, m);
+}
+
 void free_matrix(matrix *m)
 {
-    for (int r=0; r<m->num_rows; ++r)
+    if (m->map != NULL)
+    {
+        munmap(m->map, m->map_len);
+    }
+    else
     {
-        free(m->data[r]);
+        free(m->storage);
     }
     free(m->data);
     free(m);
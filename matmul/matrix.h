@@ -1,16 +1,69 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
 typedef struct _matrix
 {
     int **data;
     int num_rows;
     int num_cols;
+    int *storage;       // row-major elements, data[r] points into this
+    void *map;          // non-NULL when storage lives in an mmap'd file
+    size_t map_len;
 } matrix;
 
+// Binary matrix files start with this header, followed by zero padding up
+// to data_offset and then num_rows*num_cols elements in row-major order,
+// in host byte order.  data_offset is a multiple of alignment so the file
+// can be mapped and used in place.
+#define MATRIX_BIN_MAGIC "MATB"
+#define MATRIX_BIN_VERSION 1
+#define MATRIX_BIN_ALIGNMENT 64
+
+#define MATRIX_DTYPE_INT32 1
+#define MATRIX_DTYPE_INT8 2
+#define MATRIX_DTYPE_INT16 3
+#define MATRIX_DTYPE_INT64 4
+#define MATRIX_DTYPE_FLOAT 5
+#define MATRIX_DTYPE_DOUBLE 6
+
+typedef struct _matrix_bin_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t dtype;
+    uint32_t alignment;
+    uint64_t num_rows;
+    uint64_t num_cols;
+    uint64_t data_offset;
+} matrix_bin_header;
+
 matrix *alloc_matrix(int rows, int cols);
 matrix *read_matrix(char *fname);
+matrix *read_matrix_text(char *fname);
+matrix *map_matrix(char *fname);
+int is_binary_matrix_file(char *fname);
+size_t dtype_size(uint32_t dtype);
+void init_matrix_bin_header(matrix_bin_header *hdr, uint32_t dtype, int rows, int cols);
+void check_matrix_bin_header(matrix_bin_header *hdr, size_t file_len, char *fname);
+void *map_matrix_file(char *fname, size_t *map_len);
+void write_matrix_file(char *fname, uint32_t dtype, int rows, int cols, const void *elems);
+void write_matrix_binary(matrix *m, char *fname);
+// op(m) is m itself or its transpose, read in place
+#define GEMM_NO_TRANS 0
+#define GEMM_TRANS 1
+
+// c = alpha * op(a) * op(b) + beta * c, written into the caller's c with no
+// temporaries.  With beta 0 the old contents of c are never read.  c must
+// not share storage with a or b.
+void gemm(int trans_a, int trans_b, int alpha, matrix *a, matrix *b, int beta, matrix *c);
+
+// a fresh m1 * m2, computed through gemm
 matrix *multiply_matrix(matrix *m1, matrix *m2);
+void fprint_matrix(FILE *out, matrix *m);
 void print_matrix(matrix *m);
 void free_matrix(matrix *m);
 
@@ -3,11 +3,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <libgen.h>
 #include <time.h>
 #include <sys/time.h>
+#include <unistd.h>
 #include <pthread.h>
 #include "matrix.h"
+#include "strassen.h"
+#include "parallel_io.h"
+#include "sparse.h"
+#include "typed_matrix.h"
+#include "perfcount.h"
+#include "affinity.h"
+#include "pipeline.h"
+#include "verify.h"
  
 typedef struct _thread_args {
     int id;
@@ -15,41 +25,59 @@ typedef struct _thread_args {
     matrix *m1;
     matrix *m2;
     matrix *m3;
+    int first_touch;
+    perf_counters *perf;
 } thread_args;
 
-// function for each thread that adds data to the queue
+// each thread computes one block of rows of m3 through gemm
 void *thread_main(void *arg)
 {
     // get the arguments from the main thread
     thread_args *targs = (thread_args *)arg;
+    perf_start(targs->perf, 0);
 
-    // divide tasks as equally as possible across threads
-    int min_tasks_per_thread = targs->m1->num_rows * targs->m2->num_cols / targs->t_num;
-    int extra_tasks = targs->m1->num_rows * targs->m2->num_cols % targs->t_num;
+    // divide rows as equally as possible across threads
+    int min_rows_per_thread = targs->m1->num_rows / targs->t_num;
+    int extra_rows = targs->m1->num_rows % targs->t_num;
 
-    int my_start_task = min_tasks_per_thread * targs->id;
-    int my_num_tasks = min_tasks_per_thread;
-    if (extra_tasks > targs->id)
+    int my_first_row = min_rows_per_thread * targs->id;
+    int my_num_rows = min_rows_per_thread;
+    if (extra_rows > targs->id)
     {
-        my_start_task += targs->id;
-        ++my_num_tasks;
+        my_first_row += targs->id;
+        ++my_num_rows;
     }
     else
     {
-        my_start_task += extra_tasks;
+        my_first_row += extra_rows;
     }
 
-    for (int i = my_start_task; i < my_start_task + my_num_tasks; ++i) {
-      int r = i / targs->m2->num_cols;
-      int c = i % targs->m2->num_cols;
+    if (my_num_rows > 0)
+    {
+        matrix a_rows = { targs->m1->data + my_first_row, my_num_rows, targs->m1->num_cols,
+                          targs->m1->data[my_first_row], NULL, 0 };
+        matrix c_rows = { targs->m3->data + my_first_row, my_num_rows, targs->m3->num_cols,
+                          targs->m3->data[my_first_row], NULL, 0 };
 
-      targs->m3->data[r][c] = 0;
+        // a pinned thread copies its rows of m1 into memory it touches
+        // first, so they are local to its socket; its rows of m3 are only
+        // ever written here, so they are placed the same way
+        matrix *panel = NULL;
+        if (targs->first_touch)
+        {
+            panel = alloc_matrix(my_num_rows, targs->m1->num_cols);
+            memcpy(panel->storage, a_rows.storage, (size_t)my_num_rows*targs->m1->num_cols*sizeof(int));
+        }
 
-      for (int j = 0; j < targs->m1->num_cols; ++j) {
-        targs->m3->data[r][c] += targs->m1->data[r][j] * targs->m2->data[j][c];
-      }
+        gemm(GEMM_NO_TRANS, GEMM_NO_TRANS, 1, panel != NULL ? panel : &a_rows, targs->m2, 0, &c_rows);
+
+        if (panel != NULL)
+        {
+            free_matrix(panel);
+        }
     }
 
+    perf_stop(targs->perf);
     return NULL;
 }
 
@@ -64,26 +92,99 @@ uint64_t get_time_usec()
   return ts.tv_sec*1000000 + ts.tv_nsec/1000;
 }
 
-int main(int argc, char *argv[])
-{ 
-  if (argc != 4)
+void usage(char *prog)
+{
+  printf("usage: %s [-s cutoff] [-D] [-t dtype] [-a compact|scatter|cpu_list] [-p] [-v rounds] num_threads matrix1_file matrix2_file\n", basename(prog));
+  exit(1);
+}
+
+// Matrix Market operands are kept in CSR form; everything else is dense
+void read_operand(char *fname, int num_t, matrix **m, sparse_matrix **s)
+{
+  *m = NULL;
+  *s = NULL;
+  if (is_matrix_market_file(fname))
   {
-    printf("usage: %s matrix1_file matrix2_file\n", basename(argv[0]));
-    exit(1);
+    *s = read_sparse_matrix(fname);
   }
+  else
+  {
+    *m = read_matrix_parallel(fname, num_t);
+  }
+}
 
-  matrix *m1 = read_matrix(argv[2]);
-  matrix *m2 = read_matrix(argv[3]);
-  matrix *res = alloc_matrix(m1->num_rows, m2->num_cols);
+matrix *dense_operand(matrix *m, sparse_matrix *s)
+{
+  return m != NULL ? m : sparse_to_dense(s);
+}
 
-  int num_t = atoi(argv[1]);
+int main(int argc, char *argv[])
+{ 
+  // -s cutoff switches to the Strassen-Winograd kernel, -D disables the
+  // automatic switch to the sparse kernels for mostly-zero inputs and
+  // -t dtype multiplies with the kernel specialized for that element type;
+  // -a pins the worker threads of the dense kernel; -p overlaps reading,
+  // multiplying and printing (see pipeline.h); -v checks the result with
+  // that many rounds of Freivalds' test, block by block under -p
+  int strassen_cutoff = 0;
+  int force_dense = 0;
+  uint32_t dtype = 0;
+  affinity_policy affinity = { AFFINITY_NONE, 0, NULL };
+  int pipelined = 0;
+  int verify_rounds = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:Dt:a:pv:")) != -1)
+  {
+    switch (opt)
+    {
+      case 's':
+        strassen_cutoff = atoi(optarg);
+        if (strassen_cutoff < 1)
+        {
+          printf("error: Strassen cutoff must be positive\n");
+          exit(1);
+        }
+        break;
+      case 'D':
+        force_dense = 1;
+        break;
+      case 't':
+        dtype = dtype_from_name(optarg);
+        if (dtype == 0)
+        {
+          printf("error: unknown element type %s\n", optarg);
+          exit(1);
+        }
+        break;
+      case 'a':
+        if (!parse_affinity(optarg, &affinity))
+        {
+          printf("error: invalid affinity %s\n", optarg);
+          exit(1);
+        }
+        break;
+      case 'p':
+        pipelined = 1;
+        break;
+      case 'v':
+        verify_rounds = atoi(optarg);
+        if (verify_rounds < 1)
+        {
+          printf("error: must verify with at least one round\n");
+          exit(1);
+        }
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
 
-  if (m1->num_cols != m2->num_rows) {
-    printf("Wrong Matrices!\n");
-    exit(1);
+  if (argc - optind != 3)
+  {
+    usage(argv[0]);
   }
 
-  thread_args *targs = (thread_args *)malloc(num_t*sizeof(thread_args));
+  int num_t = atoi(argv[optind]);
 
   if (num_t < 1) {
     printf("error: must have at least one thread\n");
@@ -91,50 +192,258 @@ int main(int argc, char *argv[])
     exit(1);
   }
 
-  pthread_t *tids = (pthread_t *)malloc(num_t*sizeof(pthread_t));
-  if (tids == NULL) {
-    printf("out of memory!\n");
+  if (pipelined)
+  {
+    if (strassen_cutoff > 0 || dtype != 0)
+    {
+      printf("error: -p cannot be combined with -s or -t\n");
+      exit(1);
+    }
+
+    perf_counters perf;
+    pipeline_stats stats;
+    uint64_t start = get_time_usec();
+    perf_start(&perf, 1);
+    pipelined_multiply(argv[optind+1], argv[optind+2], num_t, &affinity,
+                       verify_rounds, (unsigned int)start, &stats);
+    perf_stop(&perf);
+    uint64_t stop = get_time_usec();
+
+    // the stages overlap, so only the end-to-end time adds up
+    fprintf(stderr, "blocks=%d of %d rows\n", stats.num_blocks, stats.block_rows);
+    fprintf(stderr, "read time=%.6lfs parse time=%.6lfs\n",
+            stats.load_usec/1000000.0, stats.parse_usec/1000000.0);
+    fprintf(stderr, "compute time=%.6lfs\n", stats.compute_usec/1000000.0);
+    fprintf(stderr, "write time=%.6lfs\n", stats.write_usec/1000000.0);
+    fprintf(stderr, "time=%.6lfs\n", (stop-start)/1000000.0);
+    if (verify_rounds > 0)
+    {
+      fprintf(stderr, "verify=%s rounds=%d time=%.6lfs\n", stats.mismatches == 0 ? "passed" : "FAILED",
+              verify_rounds, stats.verify_usec/1000000.0);
+    }
+    perf_report(stderr, "perf", &perf, 1);
+    free_affinity(&affinity);
+    return stats.mismatches == 0 ? 0 : 1;
+  }
+
+  if (dtype != 0)
+  {
+    uint64_t read_start = get_time_usec();
+    typed_matrix *t1 = read_typed_matrix(argv[optind+1], dtype);
+    typed_matrix *t2 = read_typed_matrix(argv[optind+2], dtype);
+    uint64_t read_stop = get_time_usec();
+
+    if (t1->num_cols != t2->num_rows) {
+      printf("Wrong Matrices!\n");
+      exit(1);
+    }
+
+    perf_counters perf;
+    uint64_t start = get_time_usec();
+    perf_start(&perf, 1);
+    typed_matrix *tres = typed_multiply(t1, t2, num_t);
+    perf_stop(&perf);
+    uint64_t stop = get_time_usec();
+
+    uint64_t write_start = get_time_usec();
+    print_typed_matrix(tres);
+    uint64_t write_stop = get_time_usec();
+
+    int verified = 1;
+    uint64_t verify_start = 0, verify_stop = 0;
+    if (verify_rounds > 0)
+    {
+      verify_start = get_time_usec();
+      verified = typed_freivalds_verify(t1, t2, tres, verify_rounds, num_t, (unsigned int)verify_start);
+      verify_stop = get_time_usec();
+    }
+
+    fprintf(stderr, "read time=%.6lfs\n", (read_stop-read_start)/1000000.0);
+    fprintf(stderr, "time=%.6lfs\n", (stop-start)/1000000.0);
+    fprintf(stderr, "write time=%.6lfs\n", (write_stop-write_start)/1000000.0);
+    if (verify_rounds > 0)
+    {
+      fprintf(stderr, "verify=%s rounds=%d time=%.6lfs\n", verified ? "passed" : "FAILED",
+              verify_rounds, (verify_stop-verify_start)/1000000.0);
+    }
+    perf_report(stderr, "perf", &perf, 1);
+
+    free_typed_matrix(t1);
+    free_typed_matrix(t2);
+    free_typed_matrix(tres);
+    return verified ? 0 : 1;
+  }
+
+  uint64_t read_start = get_time_usec();
+  matrix *m1, *m2;
+  sparse_matrix *s1, *s2;
+  read_operand(argv[optind+1], num_t, &m1, &s1);
+  read_operand(argv[optind+2], num_t, &m2, &s2);
+  uint64_t read_stop = get_time_usec();
+
+  int m1_cols = m1 != NULL ? m1->num_cols : s1->num_cols;
+  int m2_rows = m2 != NULL ? m2->num_rows : s2->num_rows;
+  if (m1_cols != m2_rows) {
+    printf("Wrong Matrices!\n");
     exit(1);
   }
 
-  uint64_t start = get_time_usec();  
+  matrix *res;
+  uint64_t start, stop;
 
-  for (int i=0; i<num_t; ++i)
-  {
-      targs[i].id = i;
-      targs[i].t_num = num_t;
-      targs[i].m1 = m1;
-      targs[i].m2 = m2;
-      targs[i].m3 = res;
+  // the library kernels start their own threads, so they are counted as a
+  // whole through an inherited counter; the kernel below counts per thread
+  perf_counters *perfs = (perf_counters *)malloc(num_t*sizeof(perf_counters));
+  int num_perfs = 1;
+  if (perfs == NULL) {
+    printf("out of memory!\n");
+    exit(1);
+  }
 
-      if (pthread_create(&tids[i], NULL, thread_main, &targs[i]) != 0)
-      {
-          perror("pthread_create");
-          exit(1);
-      }
+  start = get_time_usec();
+  if (!force_dense && strassen_cutoff == 0 && s1 == NULL
+      && prefer_sparse(matrix_nnz(m1), m1->num_rows, m1->num_cols))
+  {
+    s1 = sparse_from_dense(m1, SPARSE_CSR);
+  }
+  if (!force_dense && strassen_cutoff == 0 && s2 == NULL
+      && prefer_sparse(matrix_nnz(m2), m2->num_rows, m2->num_cols))
+  {
+    s2 = sparse_from_dense(m2, SPARSE_CSR);
   }
 
-  for (int i=0; i<num_t; ++i)
+  if (strassen_cutoff > 0)
   {
-    if (pthread_join(tids[i], NULL) != 0)
-    {
-      perror("pthread_join");
+    m1 = dense_operand(m1, s1);
+    m2 = dense_operand(m2, s2);
+    perf_start(&perfs[0], 1);
+    res = strassen_multiply_matrix(m1, m2, strassen_cutoff, num_t);
+    perf_stop(&perfs[0]);
+    stop = get_time_usec();
+  }
+  else if (!force_dense && s1 != NULL && s2 != NULL)
+  {
+    perf_start(&perfs[0], 1);
+    sparse_matrix *sres = sparse_sparse_multiply(s1, s2, num_t);
+    perf_stop(&perfs[0]);
+    res = sparse_to_dense(sres);
+    free_sparse_matrix(sres);
+    stop = get_time_usec();
+  }
+  else if (!force_dense && s1 != NULL)
+  {
+    m2 = dense_operand(m2, s2);
+    perf_start(&perfs[0], 1);
+    res = sparse_dense_multiply(s1, m2, num_t);
+    perf_stop(&perfs[0]);
+    stop = get_time_usec();
+  }
+  else if (!force_dense && s2 != NULL)
+  {
+    m1 = dense_operand(m1, s1);
+    perf_start(&perfs[0], 1);
+    res = dense_sparse_multiply(m1, s2, num_t);
+    perf_stop(&perfs[0]);
+    stop = get_time_usec();
+  }
+  else
+  {
+    m1 = dense_operand(m1, s1);
+    m2 = dense_operand(m2, s2);
+    res = alloc_matrix(m1->num_rows, m2->num_cols);
+    thread_args *targs = (thread_args *)malloc(num_t*sizeof(thread_args));
+
+    pthread_t *tids = (pthread_t *)malloc(num_t*sizeof(pthread_t));
+    if (targs == NULL || tids == NULL) {
+      printf("out of memory!\n");
       exit(1);
     }
+
+    for (int i=0; i<num_t; ++i)
+    {
+        targs[i].id = i;
+        targs[i].t_num = num_t;
+        targs[i].m1 = m1;
+        targs[i].m2 = m2;
+        targs[i].m3 = res;
+        targs[i].first_touch = affinity.kind != AFFINITY_NONE;
+        targs[i].perf = &perfs[i];
+
+        pthread_attr_t attr;
+        affinity_attr(&attr, &affinity, i);
+        if (pthread_create(&tids[i], &attr, thread_main, &targs[i]) != 0)
+        {
+            perror("pthread_create");
+            exit(1);
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    for (int i=0; i<num_t; ++i)
+    {
+      if (pthread_join(tids[i], NULL) != 0)
+      {
+        perror("pthread_join");
+        exit(1);
+      }
+    }
+
+    stop = get_time_usec();
+    num_perfs = num_t;
+
+    free(targs);
+    free(tids);
   }
 
-  print_matrix(res);
+  uint64_t write_start = get_time_usec();
+  print_matrix_parallel(res, num_t);
+  uint64_t write_stop = get_time_usec();
 
-  uint64_t stop = get_time_usec();  
+  int verified = 1;
+  uint64_t verify_start = 0, verify_stop = 0;
+  if (verify_rounds > 0)
+  {
+    m1 = dense_operand(m1, s1);
+    m2 = dense_operand(m2, s2);
+    verify_start = get_time_usec();
+    verified = freivalds_verify(m1, m2, res, verify_rounds, num_t, (unsigned int)verify_start);
+    verify_stop = get_time_usec();
+  }
 
-  uint64_t total = stop-start;
-  fprintf(stderr, "time=%.6lfs\n", total/1000000.0);
+  // compute time is reported on its own; I/O is timed separately
+  fprintf(stderr, "read time=%.6lfs\n", (read_stop-read_start)/1000000.0);
+  fprintf(stderr, "time=%.6lfs\n", (stop-start)/1000000.0);
+  fprintf(stderr, "write time=%.6lfs\n", (write_stop-write_start)/1000000.0);
+  if (verify_rounds > 0)
+  {
+    fprintf(stderr, "verify=%s rounds=%d time=%.6lfs\n", verified ? "passed" : "FAILED",
+            verify_rounds, (verify_stop-verify_start)/1000000.0);
+  }
+  perf_report(stderr, "perf", perfs, num_perfs);
+  if (affinity.kind != AFFINITY_NONE)
+  {
+    print_affinity(stderr, &affinity);
+  }
+  free(perfs);
+  free_affinity(&affinity);
 
-  free_matrix(m1);
-  free_matrix(m2);
+  if (m1 != NULL)
+  {
+    free_matrix(m1);
+  }
+  if (m2 != NULL)
+  {
+    free_matrix(m2);
+  }
+  if (s1 != NULL)
+  {
+    free_sparse_matrix(s1);
+  }
+  if (s2 != NULL)
+  {
+    free_sparse_matrix(s2);
+  }
   free_matrix(res);
-  free(targs);
-  free(tids);
     
-  return 0;
+  return verified ? 0 : 1;
 }
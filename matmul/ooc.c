@@ -0,0 +1,495 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "matrix.h"
+#include "ooc.h"
+
+// Tiles are streamed with pread rather than mmap so that resident memory
+// is exactly the tile buffers.  A and B each get two tile slots: while the
+// compute threads work on one pair, a loader thread fills the other pair
+// with the tiles of the next step.  Steps walk the k dimension in a
+// serpentine order, so consecutive C tiles start with the A or B tile the
+// previous one ended with and that tile is not read again.  The compute
+// threads are started once and meet at a barrier to pick up each step.
+
+typedef struct _ooc_file
+{
+    int fd;
+    char *fname;
+    int num_rows;
+    int num_cols;
+    off_t data_offset;
+} ooc_file;
+
+typedef struct _tile_slot
+{
+    unsigned *data;
+    int row_tile;
+    int col_tile;
+} tile_slot;
+
+typedef struct _tile_step
+{
+    int i;
+    int j;
+    int k;
+} tile_step;
+
+typedef struct _load_args
+{
+    ooc_file *file;
+    tile_slot *slot;
+    int tile;
+    int row_tile;
+    int col_tile;
+    ooc_stats *stats;
+} load_args;
+
+// the step the compute threads work on next, published by the main
+// thread before it waits at start and left alone until finish
+typedef struct _tile_work
+{
+    const unsigned *a;
+    const unsigned *b;
+    unsigned *c;
+    int rows;
+    int inner;
+    int cols;
+    int tile;
+    int done;
+    pthread_barrier_t start;
+    pthread_barrier_t finish;
+} tile_work;
+
+typedef struct _tile_compute_args
+{
+    int id;
+    int t_num;
+    tile_work *work;
+} tile_compute_args;
+
+static void open_matrix_file(ooc_file *f, char *fname)
+{
+    f->fname = fname;
+    f->fd = open(fname, O_RDONLY);
+    if (f->fd == -1)
+    {
+        perror("open");
+        exit(1);
+    }
+
+    struct stat st;
+    if (fstat(f->fd, &st) == -1)
+    {
+        perror("fstat");
+        exit(1);
+    }
+
+    matrix_bin_header hdr;
+    if (pread(f->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+    {
+        printf("Format error in %s\n", fname);
+        exit(1);
+    }
+    check_matrix_bin_header(&hdr, st.st_size, fname);
+    if (hdr.dtype != MATRIX_DTYPE_INT32)
+    {
+        printf("Unsupported element type in %s\n", fname);
+        exit(1);
+    }
+
+    f->num_rows = hdr.num_rows;
+    f->num_cols = hdr.num_cols;
+    f->data_offset = hdr.data_offset;
+}
+
+static void read_fully(int fd, void *buf, size_t len, off_t offset, char *fname)
+{
+    char *p = (char *)buf;
+    while (len > 0)
+    {
+        ssize_t n = pread(fd, p, len, offset);
+        if (n <= 0)
+        {
+            if (n == 0)
+            {
+                printf("Format error in %s\n", fname);
+            }
+            else
+            {
+                perror("pread");
+            }
+            exit(1);
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+}
+
+static void write_fully(int fd, const void *buf, size_t len, off_t offset)
+{
+    const char *p = (const char *)buf;
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n == -1)
+        {
+            perror("pwrite");
+            exit(1);
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+}
+
+static int tile_extent(int total, int tile, int index)
+{
+    int left = total - index*tile;
+    return left < tile ? left : tile;
+}
+
+// tile (row_tile, col_tile) of f, packed with a row stride of the tile size
+static void load_tile(load_args *largs)
+{
+    ooc_file *f = largs->file;
+    int tile = largs->tile;
+    int rows = tile_extent(f->num_rows, tile, largs->row_tile);
+    int cols = tile_extent(f->num_cols, tile, largs->col_tile);
+
+    for (int r=0; r<rows; ++r)
+    {
+        off_t offset = f->data_offset
+            + ((off_t)(largs->row_tile*tile + r)*f->num_cols + (off_t)largs->col_tile*tile)*sizeof(int);
+        read_fully(f->fd, &largs->slot->data[(size_t)r*tile], cols*sizeof(int), offset, f->fname);
+    }
+
+    largs->slot->row_tile = largs->row_tile;
+    largs->slot->col_tile = largs->col_tile;
+    largs->stats->bytes_read += (uint64_t)rows*cols*sizeof(int);
+    ++largs->stats->tiles_loaded;
+}
+
+static void *loader_main(void *arg)
+{
+    load_args *largs = (load_args *)arg;
+    for (int i=0; i<2; ++i)
+    {
+        if (largs[i].slot != NULL)
+        {
+            load_tile(&largs[i]);
+        }
+    }
+    return NULL;
+}
+
+static void compute_tile_rows(tile_work *w, int id, int t_num)
+{
+    int tile = w->tile;
+
+    // divide rows as equally as possible across threads
+    int min_rows_per_thread = w->rows / t_num;
+    int extra_rows = w->rows % t_num;
+
+    int my_start_row = min_rows_per_thread * id;
+    int my_num_rows = min_rows_per_thread;
+    if (extra_rows > id)
+    {
+        my_start_row += id;
+        ++my_num_rows;
+    }
+    else
+    {
+        my_start_row += extra_rows;
+    }
+
+    for (int r=my_start_row; r<my_start_row+my_num_rows; ++r)
+    {
+        unsigned *restrict c_row = &w->c[(size_t)r*tile];
+        for (int k=0; k<w->inner; ++k)
+        {
+            unsigned a_rk = w->a[(size_t)r*tile + k];
+            const unsigned *restrict b_row = &w->b[(size_t)k*tile];
+            for (int j=0; j<w->cols; ++j)
+            {
+                c_row[j] += a_rk * b_row[j];
+            }
+        }
+    }
+}
+
+static void *tile_compute_main(void *arg)
+{
+    tile_compute_args *targs = (tile_compute_args *)arg;
+    tile_work *w = targs->work;
+
+    for (;;)
+    {
+        pthread_barrier_wait(&w->start);
+        if (w->done)
+        {
+            break;
+        }
+        compute_tile_rows(w, targs->id, targs->t_num);
+        pthread_barrier_wait(&w->finish);
+    }
+
+    return NULL;
+}
+
+// step s of the serpentine schedule: j reverses every i, k reverses every
+// (i, j).  Steps are computed on demand so that the schedule takes no
+// memory out of the budget.
+static tile_step step_at(size_t s, int n_tiles, int k_tiles)
+{
+    size_t pair = s / k_tiles;
+    int kk = (int)(s % k_tiles);
+    int jj = (int)(pair % n_tiles);
+
+    tile_step st;
+    st.i = (int)(pair / n_tiles);
+    st.j = st.i % 2 == 0 ? jj : n_tiles-1-jj;
+    st.k = pair % 2 == 0 ? kk : k_tiles-1-kk;
+    return st;
+}
+
+// largest tile edge whose C tile plus two A and two B tiles fit what is
+// left of the budget once the per-thread bookkeeping is taken out
+static int choose_tile_size(size_t mem_budget, int num_threads, int m, int k, int n)
+{
+    size_t overhead = (size_t)num_threads*(sizeof(tile_compute_args) + sizeof(pthread_t));
+    if (mem_budget <= overhead)
+    {
+        return 0;
+    }
+    long tile = (long)sqrt((double)(mem_budget - overhead) / (5*sizeof(int)));
+    int largest = m > k ? m : k;
+    largest = largest > n ? largest : n;
+    if (tile > largest)
+    {
+        tile = largest;
+    }
+    if (tile > 64)
+    {
+        tile -= tile % 16;
+    }
+    return (int)tile;
+}
+
+void ooc_multiply(char *a_fname, char *b_fname, char *c_fname,
+                  size_t mem_budget, int num_threads, ooc_stats *stats)
+{
+    ooc_file a_file, b_file;
+    open_matrix_file(&a_file, a_fname);
+    open_matrix_file(&b_file, b_fname);
+
+    if (a_file.num_cols != b_file.num_rows)
+    {
+        printf("Matrix dimensions don't match!");
+        exit(1);
+    }
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    int m = a_file.num_rows;
+    int inner = a_file.num_cols;
+    int n = b_file.num_cols;
+
+    int tile = choose_tile_size(mem_budget, num_threads, m, inner, n);
+    if (tile < 1)
+    {
+        printf("error: memory budget too small\n");
+        exit(1);
+    }
+    memset(stats, 0, sizeof(*stats));
+    stats->tile_size = tile;
+
+    int c_fd = open(c_fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (c_fd == -1)
+    {
+        perror("open");
+        exit(1);
+    }
+    matrix_bin_header hdr;
+    init_matrix_bin_header(&hdr, MATRIX_DTYPE_INT32, m, n);
+    write_fully(c_fd, &hdr, sizeof(hdr), 0);
+    if (ftruncate(c_fd, hdr.data_offset + (off_t)m*n*sizeof(int)) == -1)
+    {
+        perror("ftruncate");
+        exit(1);
+    }
+
+    size_t tile_elems = (size_t)tile*tile;
+    unsigned *buf = (unsigned *)malloc(5*tile_elems*sizeof(unsigned));
+    if (buf == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    unsigned *c_tile = buf;
+    tile_slot a_slots[2] = { { buf + tile_elems, -1, -1 }, { buf + 2*tile_elems, -1, -1 } };
+    tile_slot b_slots[2] = { { buf + 3*tile_elems, -1, -1 }, { buf + 4*tile_elems, -1, -1 } };
+
+    int m_tiles = (m + tile - 1) / tile;
+    int k_tiles = (inner + tile - 1) / tile;
+    int n_tiles = (n + tile - 1) / tile;
+
+    size_t num_steps = (size_t)m_tiles*n_tiles*k_tiles;
+
+    tile_work work;
+    memset(&work, 0, sizeof(work));
+    work.tile = tile;
+    if (pthread_barrier_init(&work.start, NULL, num_threads+1) != 0
+        || pthread_barrier_init(&work.finish, NULL, num_threads+1) != 0)
+    {
+        printf("barrier init failed\n");
+        exit(1);
+    }
+
+    tile_compute_args *targs = (tile_compute_args *)malloc(num_threads*sizeof(tile_compute_args));
+    pthread_t *tids = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    if (targs == NULL || tids == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    for (int t=0; t<num_threads; ++t)
+    {
+        targs[t].id = t;
+        targs[t].t_num = num_threads;
+        targs[t].work = &work;
+
+        if (pthread_create(&tids[t], NULL, tile_compute_main, &targs[t]) != 0)
+        {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+
+    // the first step's tiles are loaded up front; every later load
+    // overlaps the previous step's compute
+    tile_step st = step_at(0, n_tiles, k_tiles);
+    load_args first[2] = {
+        { &a_file, &a_slots[0], tile, st.i, st.k, stats },
+        { &b_file, &b_slots[0], tile, st.k, st.j, stats },
+    };
+    loader_main(first);
+    int a_cur = 0;
+    int b_cur = 0;
+
+    for (size_t s=0; s<num_steps; ++s)
+    {
+        tile_step nx = step_at(s+1, n_tiles, k_tiles);
+        int rows = tile_extent(m, tile, st.i);
+        int k_len = tile_extent(inner, tile, st.k);
+        int cols = tile_extent(n, tile, st.j);
+
+        // each (i, j) pair takes k_tiles consecutive steps
+        if (s % k_tiles == 0)
+        {
+            memset(c_tile, 0, tile_elems*sizeof(unsigned));
+        }
+
+        pthread_t loader;
+        int a_next = a_cur;
+        int b_next = b_cur;
+        int loading = 0;
+        load_args next[2];
+        memset(next, 0, sizeof(next));
+        if (s+1 < num_steps)
+        {
+            if (a_slots[a_cur].row_tile != nx.i || a_slots[a_cur].col_tile != nx.k)
+            {
+                a_next = 1 - a_cur;
+                next[0] = (load_args){ &a_file, &a_slots[a_next], tile, nx.i, nx.k, stats };
+            }
+            else
+            {
+                ++stats->tiles_reused;
+            }
+            if (b_slots[b_cur].row_tile != nx.k || b_slots[b_cur].col_tile != nx.j)
+            {
+                b_next = 1 - b_cur;
+                next[1] = (load_args){ &b_file, &b_slots[b_next], tile, nx.k, nx.j, stats };
+            }
+            else
+            {
+                ++stats->tiles_reused;
+            }
+            if (next[0].slot != NULL || next[1].slot != NULL)
+            {
+                if (pthread_create(&loader, NULL, loader_main, next) != 0)
+                {
+                    perror("pthread_create");
+                    exit(1);
+                }
+                loading = 1;
+            }
+        }
+
+        work.a = a_slots[a_cur].data;
+        work.b = b_slots[b_cur].data;
+        work.c = c_tile;
+        work.rows = rows;
+        work.inner = k_len;
+        work.cols = cols;
+        pthread_barrier_wait(&work.start);
+        pthread_barrier_wait(&work.finish);
+
+        // C tile is complete after its last k step
+        if ((s+1) % k_tiles == 0)
+        {
+            for (int r=0; r<rows; ++r)
+            {
+                off_t offset = hdr.data_offset
+                    + ((off_t)(st.i*tile + r)*n + (off_t)st.j*tile)*sizeof(int);
+                write_fully(c_fd, &c_tile[(size_t)r*tile], cols*sizeof(int), offset);
+            }
+            stats->bytes_written += (uint64_t)rows*cols*sizeof(int);
+        }
+
+        if (loading && pthread_join(loader, NULL) != 0)
+        {
+            perror("pthread_join");
+            exit(1);
+        }
+        a_cur = a_next;
+        b_cur = b_next;
+        st = nx;
+    }
+
+    work.done = 1;
+    pthread_barrier_wait(&work.start);
+    for (int t=0; t<num_threads; ++t)
+    {
+        if (pthread_join(tids[t], NULL) != 0)
+        {
+            perror("pthread_join");
+            exit(1);
+        }
+    }
+    pthread_barrier_destroy(&work.start);
+    pthread_barrier_destroy(&work.finish);
+
+    if (close(c_fd) == -1)
+    {
+        perror("close");
+        exit(1);
+    }
+    close(a_file.fd);
+    close(b_file.fd);
+    free(targs);
+    free(tids);
+    free(buf);
+}
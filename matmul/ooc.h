@@ -0,0 +1,22 @@
+#ifndef OOC_H
+#define OOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Out-of-core multiply of two binary int32 matrix files into a third.
+// Only tiles of A, B and C are ever resident; their combined size stays
+// within mem_budget bytes.
+typedef struct _ooc_stats
+{
+    int tile_size;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t tiles_loaded;
+    uint64_t tiles_reused;
+} ooc_stats;
+
+void ooc_multiply(char *a_fname, char *b_fname, char *c_fname,
+                  size_t mem_budget, int num_threads, ooc_stats *stats);
+
+#endif
@@ -0,0 +1,111 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <libgen.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "ooc.h"
+
+uint64_t get_time_usec()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+    {
+        perror("clock_gettime");
+        exit(1);
+    }
+    return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+void usage(char *prog)
+{
+    printf("usage: %s [-m budget[K|M|G]] num_threads matrix1_file matrix2_file result_file\n", basename(prog));
+    exit(1);
+}
+
+// parses a byte count with an optional K, M or G suffix
+size_t parse_size(char *arg)
+{
+    char *end;
+    double value = strtod(arg, &end);
+    switch (*end)
+    {
+        case 'G': case 'g':
+            value *= 1024;
+            /* fall through */
+        case 'M': case 'm':
+            value *= 1024;
+            /* fall through */
+        case 'K': case 'k':
+            value *= 1024;
+            ++end;
+            break;
+    }
+    if (end == arg || *end != '\0' || value < 1)
+    {
+        return 0;
+    }
+    return (size_t)value;
+}
+
+int main(int argc, char *argv[])
+{
+    // the inputs must be binary matrix files (see matconv); the result is
+    // written in the same format
+    size_t mem_budget = 256UL*1024*1024;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'm':
+                mem_budget = parse_size(optarg);
+                if (mem_budget == 0)
+                {
+                    printf("error: invalid memory budget %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 4)
+    {
+        usage(argv[0]);
+    }
+
+    int num_t = atoi(argv[optind]);
+    if (num_t < 1)
+    {
+        printf("error: must have at least one thread\n");
+        exit(1);
+    }
+
+    ooc_stats stats;
+    uint64_t start = get_time_usec();
+    ooc_multiply(argv[optind+1], argv[optind+2], argv[optind+3], mem_budget, num_t, &stats);
+    uint64_t stop = get_time_usec();
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == -1)
+    {
+        perror("getrusage");
+        exit(1);
+    }
+
+    fprintf(stderr, "tile=%d\n", stats.tile_size);
+    fprintf(stderr, "tiles loaded=%llu reused=%llu\n",
+            (unsigned long long)stats.tiles_loaded, (unsigned long long)stats.tiles_reused);
+    fprintf(stderr, "read=%.1lfMB written=%.1lfMB\n",
+            stats.bytes_read/1048576.0, stats.bytes_written/1048576.0);
+    fprintf(stderr, "max rss=%.1lfMB\n", usage.ru_maxrss/1024.0);
+    fprintf(stderr, "time=%.6lfs\n", (stop-start)/1000000.0);
+
+    return 0;
+}
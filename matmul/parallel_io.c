@@ -0,0 +1,467 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "parallel_io.h"
+
+typedef struct _parse_args
+{
+    const char *start;
+    const char *end;
+    long num_tokens;    // pass 1 output
+    long first_index;   // pass 2 input: element index of the first token
+    long num_elems;
+    int *dest;
+    int error;
+} parse_args;
+
+typedef struct _print_args
+{
+    int id;
+    int t_num;
+    matrix *m;
+    int min;
+    int max;
+    int width;
+    char *out;          // start of the first row in the output buffer
+} print_args;
+
+static int is_space(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// decode one whitespace-delimited integer starting at *pos, wrapping on
+// overflow; returns 0 if there is no token or it is not a valid integer
+static int decode_int(const char **pos, const char *end, int *val)
+{
+    const char *p = *pos;
+    while (p < end && is_space(*p))
+    {
+        ++p;
+    }
+    if (p == end)
+    {
+        return 0;
+    }
+
+    int neg = 0;
+    if (*p == '-' || *p == '+')
+    {
+        neg = *p == '-';
+        ++p;
+    }
+    if (p == end || *p < '0' || *p > '9')
+    {
+        return 0;
+    }
+
+    unsigned acc = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        acc = acc*10 + (unsigned)(*p - '0');
+        ++p;
+    }
+    if (p < end && !is_space(*p))
+    {
+        return 0;
+    }
+
+    *val = (int)(neg ? 0u - acc : acc);
+    *pos = p;
+    return 1;
+}
+
+int parse_matrix_ints(const char **pos, const char *end, int *dest, long count)
+{
+    for (long i=0; i<count; ++i)
+    {
+        if (!decode_int(pos, end, &dest[i]))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void run_threads(void *(*fn)(void *), void *args, size_t arg_size, int num_threads)
+{
+    pthread_t *tids = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    if (tids == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int i=0; i<num_threads; ++i)
+    {
+        if (pthread_create(&tids[i], NULL, fn, (char *)args + i*arg_size) != 0)
+        {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (int i=0; i<num_threads; ++i)
+    {
+        if (pthread_join(tids[i], NULL) != 0)
+        {
+            perror("pthread_join");
+            exit(1);
+        }
+    }
+
+    free(tids);
+}
+
+static void *count_tokens_main(void *arg)
+{
+    parse_args *pargs = (parse_args *)arg;
+
+    long count = 0;
+    int in_token = 0;
+    for (const char *p=pargs->start; p<pargs->end; ++p)
+    {
+        int space = is_space(*p);
+        if (!space && !in_token)
+        {
+            ++count;
+        }
+        in_token = !space;
+    }
+    pargs->num_tokens = count;
+
+    return NULL;
+}
+
+static void *parse_tokens_main(void *arg)
+{
+    parse_args *pargs = (parse_args *)arg;
+
+    const char *p = pargs->start;
+    long idx = pargs->first_index;
+    long last = pargs->first_index + pargs->num_tokens;
+    if (last > pargs->num_elems)
+    {
+        last = pargs->num_elems;
+    }
+
+    // the first write to each element happens here, so the pages holding
+    // this chunk's rows are faulted in by the thread that parsed them
+    for (; idx<last; ++idx)
+    {
+        if (!decode_int(&p, pargs->end, &pargs->dest[idx]))
+        {
+            pargs->error = 1;
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+matrix *read_matrix_parallel(char *fname, int num_threads)
+{
+    if (is_binary_matrix_file(fname))
+    {
+        return map_matrix(fname);
+    }
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1)
+    {
+        perror("open");
+        exit(1);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        perror("fstat");
+        exit(1);
+    }
+    size_t len = st.st_size;
+    if (len == 0)
+    {
+        printf("Format error in %s\n", fname);
+        exit(1);
+    }
+
+    const char *buf = (const char *)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (buf == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+    close(fd);
+
+    const char *pos = buf;
+    const char *end = buf + len;
+
+    int num_rows, num_cols;
+    if (!decode_int(&pos, end, &num_rows) || !decode_int(&pos, end, &num_cols))
+    {
+        printf("Format error in %s\n", fname);
+        exit(1);
+    }
+    if (num_rows < 1)
+    {
+        printf("Row value error in %s\n", fname);
+        exit(1);
+    }
+    if (num_cols < 1)
+    {
+        printf("Column value error in %s\n", fname);
+        exit(1);
+    }
+
+    matrix *m = alloc_matrix(num_rows, num_cols);
+
+    parse_args *pargs = (parse_args *)malloc(num_threads*sizeof(parse_args));
+    if (pargs == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    // split the body into roughly equal chunks that end on a line break,
+    // so no token straddles two chunks and rows usually stay together
+    size_t body_len = end - pos;
+    const char *chunk_start = pos;
+    for (int i=0; i<num_threads; ++i)
+    {
+        const char *chunk_end = pos + body_len*(i+1)/num_threads;
+        if (chunk_end < chunk_start)
+        {
+            chunk_end = chunk_start;
+        }
+        while (chunk_end < end && chunk_end[-1] != '\n')
+        {
+            ++chunk_end;
+        }
+
+        pargs[i].start = chunk_start;
+        pargs[i].end = chunk_end;
+        pargs[i].num_elems = (long)num_rows*num_cols;
+        pargs[i].dest = m->storage;
+        pargs[i].error = 0;
+        chunk_start = chunk_end;
+    }
+
+    run_threads(count_tokens_main, pargs, sizeof(parse_args), num_threads);
+
+    long total = 0;
+    for (int i=0; i<num_threads; ++i)
+    {
+        pargs[i].first_index = total;
+        total += pargs[i].num_tokens;
+    }
+    if (total < (long)num_rows*num_cols)
+    {
+        printf("Format error in %s\n", fname);
+        exit(1);
+    }
+
+    run_threads(parse_tokens_main, pargs, sizeof(parse_args), num_threads);
+
+    for (int i=0; i<num_threads; ++i)
+    {
+        if (pargs[i].error)
+        {
+            printf("Format error in %s\n", fname);
+            exit(1);
+        }
+    }
+
+    free(pargs);
+    munmap((void *)buf, len);
+    return m;
+}
+
+static void thread_rows(int id, int t_num, int num_rows, int *first, int *count)
+{
+    // divide rows as equally as possible across threads
+    int min_rows_per_thread = num_rows / t_num;
+    int extra_rows = num_rows % t_num;
+
+    *first = min_rows_per_thread * id;
+    *count = min_rows_per_thread;
+    if (extra_rows > id)
+    {
+        *first += id;
+        ++*count;
+    }
+    else
+    {
+        *first += extra_rows;
+    }
+}
+
+static void *min_max_main(void *arg)
+{
+    print_args *pargs = (print_args *)arg;
+    matrix *m = pargs->m;
+
+    int first, count;
+    thread_rows(pargs->id, pargs->t_num, m->num_rows, &first, &count);
+
+    int max = m->data[0][0];
+    int min = m->data[0][0];
+    for (int r=first; r<first+count; ++r)
+    {
+        for (int c=0; c<m->num_cols; ++c)
+        {
+            if (max < m->data[r][c])
+            {
+                max = m->data[r][c];
+            }
+            if (min > m->data[r][c])
+            {
+                min = m->data[r][c];
+            }
+        }
+    }
+    pargs->min = min;
+    pargs->max = max;
+
+    return NULL;
+}
+
+size_t format_matrix_rows(matrix *m, int first, int count, int width, char *out)
+{
+    char *p = out;
+    for (int r=first; r<first+count; ++r)
+    {
+        for (int c=0; c<m->num_cols; ++c)
+        {
+            // right-align the digits in a field of exactly width chars,
+            // as printf("%*d") does
+            int v = m->data[r][c];
+            unsigned u = v < 0 ? 0u - (unsigned)v : (unsigned)v;
+            char *q = p + width;
+            do
+            {
+                *--q = '0' + u%10;
+                u /= 10;
+            } while (u != 0);
+            if (v < 0)
+            {
+                *--q = '-';
+            }
+            while (q > p)
+            {
+                *--q = ' ';
+            }
+            p += width;
+        }
+        *p++ = '\n';
+    }
+    return p - out;
+}
+
+static void *format_rows_main(void *arg)
+{
+    print_args *pargs = (print_args *)arg;
+    matrix *m = pargs->m;
+    size_t row_len = (size_t)m->num_cols*pargs->width + 1;
+
+    int first, count;
+    thread_rows(pargs->id, pargs->t_num, m->num_rows, &first, &count);
+    format_matrix_rows(m, first, count, pargs->width, pargs->out + (size_t)first*row_len);
+
+    return NULL;
+}
+
+void print_matrix_parallel(matrix *m, int num_threads)
+{
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+    if (num_threads > m->num_rows)
+    {
+        num_threads = m->num_rows;
+    }
+
+    print_args *pargs = (print_args *)malloc(num_threads*sizeof(print_args));
+    if (pargs == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i=0; i<num_threads; ++i)
+    {
+        pargs[i].id = i;
+        pargs[i].t_num = num_threads;
+        pargs[i].m = m;
+    }
+
+    run_threads(min_max_main, pargs, sizeof(print_args), num_threads);
+
+    int max = pargs[0].max;
+    int min = pargs[0].min;
+    for (int i=1; i<num_threads; ++i)
+    {
+        if (max < pargs[i].max)
+        {
+            max = pargs[i].max;
+        }
+        if (min > pargs[i].min)
+        {
+            min = pargs[i].min;
+        }
+    }
+    int max_len = snprintf(NULL, 0, "%d", max);
+    int min_len = snprintf(NULL, 0, "%d", min);
+    int longest = max_len>min_len ? max_len : min_len;
+
+    // every field is exactly longest+1 chars wide, so each row's offset in
+    // the output is known before anything is formatted
+    char header[32];
+    int header_len = snprintf(header, sizeof(header), "%d\n%d\n", m->num_rows, m->num_cols);
+    size_t row_len = (size_t)m->num_cols*(longest+1) + 1;
+    size_t total = header_len + row_len*m->num_rows;
+
+    char *out = (char *)malloc(total);
+    if (out == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    memcpy(out, header, header_len);
+
+    for (int i=0; i<num_threads; ++i)
+    {
+        pargs[i].width = longest+1;
+        pargs[i].out = out + header_len;
+    }
+
+    run_threads(format_rows_main, pargs, sizeof(print_args), num_threads);
+
+    fflush(stdout);
+    size_t written = 0;
+    while (written < total)
+    {
+        ssize_t n = write(STDOUT_FILENO, out + written, total - written);
+        if (n == -1)
+        {
+            perror("write");
+            exit(1);
+        }
+        written += n;
+    }
+
+    free(out);
+    free(pargs);
+}
@@ -0,0 +1,20 @@
+#ifndef PARALLEL_IO_H
+#define PARALLEL_IO_H
+
+#include "matrix.h"
+
+// Multi-threaded counterparts of read_matrix and print_matrix.  The reader
+// accepts the same text (and binary) files and the writer produces output
+// byte-identical to print_matrix.
+matrix *read_matrix_parallel(char *fname, int num_threads);
+void print_matrix_parallel(matrix *m, int num_threads);
+
+// The building blocks, for callers that stream.  parse_matrix_ints decodes
+// count whitespace-separated integers starting at *pos and advances it,
+// returning 0 on malformed input.  format_matrix_rows writes rows
+// [first, first+count) of m with every field exactly width chars wide and
+// returns the number of chars written, count*(num_cols*width + 1).
+int parse_matrix_ints(const char **pos, const char *end, int *dest, long count);
+size_t format_matrix_rows(matrix *m, int first, int count, int width, char *out);
+
+#endif
@@ -0,0 +1,370 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "matrix.h"
+#include "parallel_io.h"
+#include "sparse.h"
+#include "verify.h"
+#include "pipeline.h"
+
+// blocks that may be finished but not yet written, per worker; bounds the
+// memory held by formatted output when the writer falls behind
+#define PIPELINE_AHEAD_PER_THREAD 4
+
+typedef struct _pipeline
+{
+    matrix *a;
+    matrix *b;
+    freivalds_vectors *fv;      // NULL unless blocks are verified
+    int block_rows;
+    int num_blocks;
+    int max_ahead;
+
+    // the unparsed rest of a, when it is a text file
+    const char *text;
+    size_t text_len;
+    const char *pos;
+    char *a_fname;
+
+    // shared state, guarded by lock
+    int rows_parsed;
+    int next_block;
+    int blocks_written;
+    char **out;
+    size_t *out_len;
+    uint64_t compute_usec;
+    uint64_t verify_usec;
+    long mismatches;
+    pthread_mutex_t lock;
+    pthread_cond_t rows_ready;
+    pthread_cond_t block_ready;
+    pthread_cond_t space_ready;
+
+    uint64_t parse_usec;
+} pipeline;
+
+static uint64_t pipeline_time_usec()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+    {
+        perror("clock_gettime");
+        exit(1);
+    }
+    return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+// maps a text matrix file, decodes its dimensions and leaves pl->pos at
+// the first element
+static void open_text(pipeline *pl, char *fname)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1)
+    {
+        perror("open");
+        exit(1);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        perror("fstat");
+        exit(1);
+    }
+    pl->text_len = st.st_size;
+    if (pl->text_len == 0)
+    {
+        printf("Format error in %s\n", fname);
+        exit(1);
+    }
+
+    pl->text = (const char *)mmap(NULL, pl->text_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pl->text == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+    close(fd);
+
+    pl->pos = pl->text;
+    int dims[2];
+    if (!parse_matrix_ints(&pl->pos, pl->text + pl->text_len, dims, 2))
+    {
+        printf("Format error in %s\n", fname);
+        exit(1);
+    }
+    if (dims[0] < 1)
+    {
+        printf("Row value error in %s\n", fname);
+        exit(1);
+    }
+    if (dims[1] < 1)
+    {
+        printf("Column value error in %s\n", fname);
+        exit(1);
+    }
+
+    // the parser is the first to write these pages
+    pl->a = alloc_matrix(dims[0], dims[1]);
+}
+
+// parses a block of rows of a at a time, publishing each as it is done
+static void *parse_main(void *arg)
+{
+    pipeline *pl = (pipeline *)arg;
+    uint64_t start = pipeline_time_usec();
+    const char *end = pl->text + pl->text_len;
+
+    for (int first=0; first<pl->a->num_rows; first+=pl->block_rows)
+    {
+        int count = pl->a->num_rows - first < pl->block_rows ? pl->a->num_rows - first : pl->block_rows;
+        if (!parse_matrix_ints(&pl->pos, end, pl->a->data[first], (long)count*pl->a->num_cols))
+        {
+            printf("Format error in %s\n", pl->a_fname);
+            exit(1);
+        }
+
+        pthread_mutex_lock(&pl->lock);
+        pl->rows_parsed = first + count;
+        pthread_cond_broadcast(&pl->rows_ready);
+        pthread_mutex_unlock(&pl->lock);
+    }
+
+    pl->parse_usec = pipeline_time_usec() - start;
+    munmap((void *)pl->text, pl->text_len);
+    return NULL;
+}
+
+static void *compute_main(void *arg)
+{
+    pipeline *pl = (pipeline *)arg;
+    int cols = pl->b->num_cols;
+    size_t row_len = (size_t)cols*PIPELINE_FIELD_WIDTH + 1;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pl->lock);
+        while (pl->next_block < pl->num_blocks
+               && pl->next_block >= pl->blocks_written + pl->max_ahead)
+        {
+            pthread_cond_wait(&pl->space_ready, &pl->lock);
+        }
+        if (pl->next_block == pl->num_blocks)
+        {
+            pthread_mutex_unlock(&pl->lock);
+            break;
+        }
+        int block = pl->next_block++;
+        int first = block*pl->block_rows;
+        int count = pl->a->num_rows - first < pl->block_rows ? pl->a->num_rows - first : pl->block_rows;
+        while (pl->rows_parsed < first + count)
+        {
+            pthread_cond_wait(&pl->rows_ready, &pl->lock);
+        }
+        pthread_mutex_unlock(&pl->lock);
+
+        uint64_t start = pipeline_time_usec();
+        matrix a_rows = { pl->a->data + first, count, pl->a->num_cols, pl->a->data[first], NULL, 0 };
+        matrix *c_rows = alloc_matrix(count, cols);
+        gemm(GEMM_NO_TRANS, GEMM_NO_TRANS, 1, &a_rows, pl->b, 0, c_rows);
+        uint64_t verify_start = pipeline_time_usec();
+        long mismatches = pl->fv != NULL ? freivalds_check_rows(pl->fv, &a_rows, c_rows) : 0;
+        uint64_t verify_stop = pipeline_time_usec();
+
+        char *text = (char *)malloc(count*row_len);
+        if (text == NULL)
+        {
+            perror("malloc");
+            exit(1);
+        }
+        size_t len = format_matrix_rows(c_rows, 0, count, PIPELINE_FIELD_WIDTH, text);
+        free_matrix(c_rows);
+        uint64_t stop = pipeline_time_usec();
+
+        pthread_mutex_lock(&pl->lock);
+        pl->out[block] = text;
+        pl->out_len[block] = len;
+        pl->compute_usec += stop - start - (verify_stop - verify_start);
+        pl->verify_usec += verify_stop - verify_start;
+        pl->mismatches += mismatches;
+        pthread_cond_broadcast(&pl->block_ready);
+        pthread_mutex_unlock(&pl->lock);
+    }
+
+    return NULL;
+}
+
+static void write_all(const char *buf, size_t len)
+{
+    size_t written = 0;
+    while (written < len)
+    {
+        ssize_t n = write(STDOUT_FILENO, buf + written, len - written);
+        if (n == -1)
+        {
+            perror("write");
+            exit(1);
+        }
+        written += n;
+    }
+}
+
+void pipelined_multiply(char *a_fname, char *b_fname, int num_threads,
+                        affinity_policy *affinity, int verify_rounds,
+                        unsigned int seed, pipeline_stats *stats)
+{
+    if (is_matrix_market_file(a_fname) || is_matrix_market_file(b_fname))
+    {
+        printf("error: the pipelined multiply needs dense matrix files\n");
+        exit(1);
+    }
+
+    pipeline pl;
+    memset(&pl, 0, sizeof(pl));
+    pl.a_fname = a_fname;
+    pthread_mutex_init(&pl.lock, NULL);
+    pthread_cond_init(&pl.rows_ready, NULL);
+    pthread_cond_init(&pl.block_ready, NULL);
+    pthread_cond_init(&pl.space_ready, NULL);
+
+    // a binary a is mapped and ready at once; a text a is parsed by its own
+    // thread while b is being loaded
+    int parsing = !is_binary_matrix_file(a_fname);
+    if (parsing)
+    {
+        open_text(&pl, a_fname);
+    }
+    else
+    {
+        pl.a = map_matrix(a_fname);
+        pl.rows_parsed = pl.a->num_rows;
+    }
+
+    // b is not loaded yet, so blocks are sized from a's width; the parser
+    // publishes rows in the same units
+    pl.block_rows = PIPELINE_BLOCK_ELEMS / pl.a->num_cols;
+    if (pl.block_rows < 1)
+    {
+        pl.block_rows = 1;
+    }
+    pl.num_blocks = (pl.a->num_rows + pl.block_rows - 1) / pl.block_rows;
+    pl.max_ahead = PIPELINE_AHEAD_PER_THREAD*num_threads;
+
+    pthread_t parser;
+    if (parsing && pthread_create(&parser, NULL, parse_main, &pl) != 0)
+    {
+        perror("pthread_create");
+        exit(1);
+    }
+
+    uint64_t load_start = pipeline_time_usec();
+    pl.b = read_matrix_parallel(b_fname, num_threads);
+    stats->load_usec = pipeline_time_usec() - load_start;
+
+    if (pl.a->num_cols != pl.b->num_rows)
+    {
+        printf("Wrong Matrices!\n");
+        exit(1);
+    }
+
+    uint64_t prepare_usec = 0;
+    if (verify_rounds > 0)
+    {
+        uint64_t prepare_start = pipeline_time_usec();
+        pl.fv = freivalds_prepare(pl.b, verify_rounds, num_threads, seed);
+        prepare_usec = pipeline_time_usec() - prepare_start;
+    }
+
+    pl.out = (char **)calloc(pl.num_blocks, sizeof(char *));
+    pl.out_len = (size_t *)malloc(pl.num_blocks*sizeof(size_t));
+    pthread_t *workers = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    if (pl.out == NULL || pl.out_len == NULL || workers == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int i=0; i<num_threads; ++i)
+    {
+        pthread_attr_t attr;
+        affinity_attr(&attr, affinity, i);
+        if (pthread_create(&workers[i], &attr, compute_main, &pl) != 0)
+        {
+            perror("pthread_create");
+            exit(1);
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    // this thread is the writer: blocks go out strictly in order
+    uint64_t write_usec = 0;
+    char header[32];
+    int header_len = snprintf(header, sizeof(header), "%d\n%d\n", pl.a->num_rows, pl.b->num_cols);
+    fflush(stdout);
+    write_all(header, header_len);
+
+    for (int block=0; block<pl.num_blocks; ++block)
+    {
+        pthread_mutex_lock(&pl.lock);
+        while (pl.out[block] == NULL)
+        {
+            pthread_cond_wait(&pl.block_ready, &pl.lock);
+        }
+        pthread_mutex_unlock(&pl.lock);
+
+        uint64_t start = pipeline_time_usec();
+        write_all(pl.out[block], pl.out_len[block]);
+        write_usec += pipeline_time_usec() - start;
+        free(pl.out[block]);
+
+        pthread_mutex_lock(&pl.lock);
+        ++pl.blocks_written;
+        pthread_cond_broadcast(&pl.space_ready);
+        pthread_mutex_unlock(&pl.lock);
+    }
+
+    for (int i=0; i<num_threads; ++i)
+    {
+        if (pthread_join(workers[i], NULL) != 0)
+        {
+            perror("pthread_join");
+            exit(1);
+        }
+    }
+    if (parsing && pthread_join(parser, NULL) != 0)
+    {
+        perror("pthread_join");
+        exit(1);
+    }
+
+    stats->block_rows = pl.block_rows;
+    stats->num_blocks = pl.num_blocks;
+    stats->parse_usec = pl.parse_usec;
+    stats->compute_usec = pl.compute_usec / num_threads;
+    stats->write_usec = write_usec;
+    stats->verify_usec = prepare_usec + pl.verify_usec / num_threads;
+    stats->mismatches = pl.mismatches;
+
+    free(workers);
+    free(pl.out);
+    free(pl.out_len);
+    free_matrix(pl.a);
+    free_matrix(pl.b);
+    if (pl.fv != NULL)
+    {
+        free_freivalds_vectors(pl.fv);
+    }
+    pthread_mutex_destroy(&pl.lock);
+    pthread_cond_destroy(&pl.rows_ready);
+    pthread_cond_destroy(&pl.block_ready);
+    pthread_cond_destroy(&pl.space_ready);
+}
@@ -0,0 +1,40 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include "affinity.h"
+
+// Pipelined a * b printed to stdout.  b is loaded while a is parsed, row
+// blocks of a are multiplied as soon as b is resident and they have been
+// parsed, and finished blocks of the result are written in order while
+// later ones are still being computed.  a and b are dense text or binary
+// matrix files.  With verify_rounds > 0 each block of the result is also
+// checked with Freivalds' test (see verify.h) before it is formatted, so
+// no copy of the result is kept for a check at the end.
+//
+// print_matrix sizes its columns from the largest value in the whole
+// result, which is not known until the end, so every field here is as wide
+// as the widest int instead.  The output reads back the same.
+#define PIPELINE_FIELD_WIDTH 12
+
+// elements of a per block of rows; a very wide a gets one row per block
+#define PIPELINE_BLOCK_ELEMS 16384
+
+// per-stage busy times, to compare against the end-to-end time
+typedef struct _pipeline_stats
+{
+    int block_rows;
+    int num_blocks;
+    uint64_t load_usec;         // loading b
+    uint64_t parse_usec;        // parsing a, overlapped with the above
+    uint64_t compute_usec;      // multiplying and formatting, per worker
+    uint64_t write_usec;        // in write(), excluding waits for blocks
+    uint64_t verify_usec;       // b * r, plus the block checks per worker
+    long mismatches;            // entries of c * r that failed the check
+} pipeline_stats;
+
+void pipelined_multiply(char *a_fname, char *b_fname, int num_threads,
+                        affinity_policy *affinity, int verify_rounds,
+                        unsigned int seed, pipeline_stats *stats);
+
+#endif
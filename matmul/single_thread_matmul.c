@@ -27,20 +27,26 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    uint64_t read_start = get_time_usec();
     matrix *m1 = read_matrix(argv[1]);
     matrix *m2 = read_matrix(argv[2]);
+    uint64_t read_stop = get_time_usec();
 
     uint64_t start = get_time_usec();
     matrix *res = multiply_matrix(m1, m2);
     uint64_t stop = get_time_usec();
 
+    uint64_t write_start = get_time_usec();
     print_matrix(res);
+    uint64_t write_stop = get_time_usec();
+
     free_matrix(m1);
     free_matrix(m2);
     free_matrix(res);
 
-    uint64_t total = stop-start;
-    fprintf(stderr, "time=%.6lfs\n", total/1000000.0);
+    fprintf(stderr, "read time=%.6lfs\n", (read_stop-read_start)/1000000.0);
+    fprintf(stderr, "time=%.6lfs\n", (stop-start)/1000000.0);
+    fprintf(stderr, "write time=%.6lfs\n", (write_stop-write_start)/1000000.0);
     
     return 0;
 }
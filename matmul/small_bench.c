@@ -0,0 +1,251 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <libgen.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "matrix.h"
+#include "small_matmul.h"
+
+#define MAX_LIST 64
+
+typedef struct _small_variant
+{
+    const char *name;
+    int threaded;       // 0: run once, at the first thread count only
+    void (*run)(const int *a, const int *b, int *c, int m, int k, int n, long count, int num_threads);
+} small_variant;
+
+typedef struct _bench_shape
+{
+    int m;
+    int k;
+    int n;
+} bench_shape;
+
+uint64_t get_time_usec()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+    {
+        perror("clock_gettime");
+        exit(1);
+    }
+    return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+// what callers do today: a matrix per product, multiplied with
+// multiply_matrix, which allocates every result
+void run_matrix(const int *a, const int *b, int *c, int m, int k, int n, long count, int num_threads)
+{
+    int *a_rows[m];
+    int *b_rows[k];
+    for (long i=0; i<count; ++i)
+    {
+        int *a_i = (int *)a + i*m*k;
+        int *b_i = (int *)b + i*k*n;
+        for (int r=0; r<m; ++r)
+        {
+            a_rows[r] = a_i + r*k;
+        }
+        for (int r=0; r<k; ++r)
+        {
+            b_rows[r] = b_i + r*n;
+        }
+        matrix m1 = { a_rows, m, k, a_i, NULL, 0 };
+        matrix m2 = { b_rows, k, n, b_i, NULL, 0 };
+
+        matrix *res = multiply_matrix(&m1, &m2);
+        memcpy(c + i*m*n, res->storage, (size_t)m*n*sizeof(int));
+        free_matrix(res);
+    }
+}
+
+// the expected results, from the textbook triple loop so that no kernel
+// under test checks itself
+void naive_batch(const int *a, const int *b, int *c, int m, int k, int n, long count)
+{
+    for (long i=0; i<count; ++i, a+=m*k, b+=k*n, c+=m*n)
+    {
+        for (int r=0; r<m; ++r)
+        {
+            for (int j=0; j<n; ++j)
+            {
+                unsigned sum = 0;
+                for (int p=0; p<k; ++p)
+                {
+                    sum += (unsigned)a[r*k + p] * (unsigned)b[p*n + j];
+                }
+                c[r*n + j] = (int)sum;
+            }
+        }
+    }
+}
+
+static small_variant all_variants[] = {
+    { "matrix",      0, run_matrix },
+    { "generic",     1, small_multiply_batch_generic },
+    { "specialized", 1, small_multiply_batch },
+};
+
+#define NUM_VARIANTS ((int)(sizeof(all_variants)/sizeof(all_variants[0])))
+
+void usage(char *prog)
+{
+    printf("usage: %s [-s MxKxN[,...]] [-c count] [-t threads[,...]] [-r repeats] [-S seed]\n",
+           basename(prog));
+    exit(1);
+}
+
+int parse_shapes(char *arg, bench_shape *shapes)
+{
+    int count = 0;
+    for (char *tok=strtok(arg, ","); tok != NULL; tok=strtok(NULL, ","))
+    {
+        bench_shape *s = &shapes[count];
+        if (count == MAX_LIST || sscanf(tok, "%dx%dx%d", &s->m, &s->k, &s->n) != 3
+            || s->m < 1 || s->k < 1 || s->n < 1)
+        {
+            return 0;
+        }
+        ++count;
+    }
+    return count;
+}
+
+int parse_threads(char *arg, int *threads)
+{
+    int count = 0;
+    for (char *tok=strtok(arg, ","); tok != NULL; tok=strtok(NULL, ","))
+    {
+        if (count == MAX_LIST || (threads[count] = atoi(tok)) < 1)
+        {
+            return 0;
+        }
+        ++count;
+    }
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    bench_shape shapes[MAX_LIST] = { { 4, 4, 4 }, { 8, 8, 8 }, { 16, 16, 16 }, { 16, 4, 4 } };
+    int num_shapes = 4;
+    int threads[MAX_LIST] = { 1 };
+    int num_threads = 1;
+    long count = 100000;
+    int repeats = 3;
+    unsigned seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:c:t:r:S:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                if ((num_shapes = parse_shapes(optarg, shapes)) == 0)
+                {
+                    usage(argv[0]);
+                }
+                break;
+            case 'c':
+                count = atol(optarg);
+                break;
+            case 't':
+                if ((num_threads = parse_threads(optarg, threads)) == 0)
+                {
+                    usage(argv[0]);
+                }
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            case 'S':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc || count < 1 || repeats < 1)
+    {
+        usage(argv[0]);
+    }
+
+    srandom(seed);
+    printf("m,k,n,count,kernel,specialized,threads,repeats,mean_s,min_s,products_per_s,gops,verified\n");
+
+    for (int s=0; s<num_shapes; ++s)
+    {
+        bench_shape *sh = &shapes[s];
+        size_t a_len = (size_t)count*sh->m*sh->k;
+        size_t b_len = (size_t)count*sh->k*sh->n;
+        size_t c_len = (size_t)count*sh->m*sh->n;
+        int *a = (int *)malloc(a_len*sizeof(int));
+        int *b = (int *)malloc(b_len*sizeof(int));
+        int *c = (int *)malloc(c_len*sizeof(int));
+        int *expected = (int *)malloc(c_len*sizeof(int));
+        if (a == NULL || b == NULL || c == NULL || expected == NULL)
+        {
+            perror("malloc");
+            exit(1);
+        }
+        for (size_t i=0; i<a_len; ++i)
+        {
+            a[i] = (int)(random() % 201) - 100;
+        }
+        for (size_t i=0; i<b_len; ++i)
+        {
+            b[i] = (int)(random() % 201) - 100;
+        }
+        naive_batch(a, b, expected, sh->m, sh->k, sh->n, count);
+
+        int specialized = small_kernel_specialized(sh->m, sh->k, sh->n);
+        double ops = 2.0*sh->m*sh->k*sh->n*count;
+
+        for (int v=0; v<NUM_VARIANTS; ++v)
+        {
+            small_variant *var = &all_variants[v];
+            for (int t=0; t<(var->threaded ? num_threads : 1); ++t)
+            {
+                int nt = threads[t];
+
+                double sum = 0, min = 0;
+                const char *verified = "yes";
+                for (int r=0; r<repeats; ++r)
+                {
+                    memset(c, 0, c_len*sizeof(int));
+                    uint64_t start = get_time_usec();
+                    var->run(a, b, c, sh->m, sh->k, sh->n, count, nt);
+                    uint64_t stop = get_time_usec();
+
+                    double secs = (stop-start)/1000000.0;
+                    sum += secs;
+                    min = r == 0 || secs < min ? secs : min;
+                    if (memcmp(c, expected, c_len*sizeof(int)) != 0)
+                    {
+                        verified = "NO";
+                    }
+                }
+                double mean = sum/repeats;
+
+                printf("%d,%d,%d,%ld,%s,%d,%d,%d,%.6lf,%.6lf,%.0lf,%.3lf,%s\n",
+                       sh->m, sh->k, sh->n, count, var->name, specialized, nt, repeats,
+                       mean, min, count/mean, ops/mean/1e9, verified);
+                fflush(stdout);
+            }
+        }
+
+        free(a);
+        free(b);
+        free(c);
+        free(expected);
+    }
+
+    return 0;
+}
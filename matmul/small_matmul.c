@@ -0,0 +1,241 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "small_matmul.h"
+
+// Shapes with their own kernel, as m, k, n.  The bounds are constants:
+// the k loop is unrolled completely and the n loop becomes a fixed number
+// of vector operations, so each row of the result is accumulated in
+// registers and stored once.  (Unrolling the n loop as well stops it being
+// vectorized, and is slower from 8x8 up.)  Arithmetic is unsigned so that
+// overflow wraps like multiply_matrix.
+#define FOR_EACH_SMALL_SHAPE(X) \
+    X(4, 4, 4)                  \
+    X(8, 8, 8)                  \
+    X(16, 16, 16)               \
+    X(16, 4, 4)
+
+typedef void (*small_kernel)(const unsigned *a, const unsigned *b, unsigned *c,
+                             int m, int k, int n, long count);
+
+typedef struct _small_shape
+{
+    int m;
+    int k;
+    int n;
+    small_kernel kernel;
+} small_shape;
+
+typedef struct _small_args
+{
+    int id;
+    int t_num;
+    small_kernel kernel;
+    const unsigned *a;
+    const unsigned *b;
+    unsigned *c;
+    int m;
+    int k;
+    int n;
+    long count;
+} small_args;
+
+#define DEFINE_SMALL_KERNEL(M, K, N)                                             \
+static void small_kernel_##M##x##K##x##N(const unsigned *restrict a,             \
+                                         const unsigned *restrict b,             \
+                                         unsigned *restrict c,                   \
+                                         int m, int k, int n, long count)        \
+{                                                                                \
+    for (long i=0; i<count; ++i, a+=M*K, b+=K*N, c+=M*N)                         \
+    {                                                                            \
+        for (int r=0; r<M; ++r)                                                  \
+        {                                                                        \
+            unsigned acc[N];                                                     \
+            for (int j=0; j<N; ++j)                                              \
+            {                                                                    \
+                acc[j] = a[r*K] * b[j];                                          \
+            }                                                                    \
+            _Pragma("GCC unroll 16")                                             \
+            for (int p=1; p<K; ++p)                                              \
+            {                                                                    \
+                unsigned a_rp = a[r*K + p];                                      \
+                for (int j=0; j<N; ++j)                                          \
+                {                                                                \
+                    acc[j] += a_rp * b[p*N + j];                                 \
+                }                                                                \
+            }                                                                    \
+            for (int j=0; j<N; ++j)                                              \
+            {                                                                    \
+                c[r*N + j] = acc[j];                                             \
+            }                                                                    \
+        }                                                                        \
+    }                                                                            \
+}
+
+FOR_EACH_SMALL_SHAPE(DEFINE_SMALL_KERNEL)
+
+#define SMALL_SHAPE_ENTRY(M, K, N) { M, K, N, small_kernel_##M##x##K##x##N },
+
+static const small_shape all_small_shapes[] = {
+    FOR_EACH_SMALL_SHAPE(SMALL_SHAPE_ENTRY)
+};
+
+static void small_kernel_generic(const unsigned *a, const unsigned *b, unsigned *c,
+                                 int m, int k, int n, long count)
+{
+    for (long i=0; i<count; ++i, a+=(size_t)m*k, b+=(size_t)k*n, c+=(size_t)m*n)
+    {
+        for (int r=0; r<m; ++r)
+        {
+            unsigned *restrict c_row = c + (size_t)r*n;
+            for (int j=0; j<n; ++j)
+            {
+                c_row[j] = 0;
+            }
+            for (int p=0; p<k; ++p)
+            {
+                unsigned a_rp = a[(size_t)r*k + p];
+                const unsigned *restrict b_row = b + (size_t)p*n;
+                for (int j=0; j<n; ++j)
+                {
+                    c_row[j] += a_rp * b_row[j];
+                }
+            }
+        }
+    }
+}
+
+static small_kernel kernel_for(int m, int k, int n)
+{
+    for (size_t i=0; i<sizeof(all_small_shapes)/sizeof(all_small_shapes[0]); ++i)
+    {
+        const small_shape *s = &all_small_shapes[i];
+        if (s->m == m && s->k == k && s->n == n)
+        {
+            return s->kernel;
+        }
+    }
+    return NULL;
+}
+
+int small_kernel_specialized(int m, int k, int n)
+{
+    return kernel_for(m, k, n) != NULL;
+}
+
+int small_multiply(const int *a, const int *b, int *c, int m, int k, int n)
+{
+    small_kernel kernel = kernel_for(m, k, n);
+    if (kernel == NULL)
+    {
+        return 0;
+    }
+    kernel((const unsigned *)a, (const unsigned *)b, (unsigned *)c, m, k, n, 1);
+    return 1;
+}
+
+static void *small_batch_main(void *arg)
+{
+    small_args *targs = (small_args *)arg;
+
+    // divide products as equally as possible across threads
+    long min_per_thread = targs->count / targs->t_num;
+    long extra = targs->count % targs->t_num;
+
+    long first = min_per_thread * targs->id;
+    long num = min_per_thread;
+    if (extra > targs->id)
+    {
+        first += targs->id;
+        ++num;
+    }
+    else
+    {
+        first += extra;
+    }
+
+    targs->kernel(targs->a + first*targs->m*targs->k, targs->b + first*targs->k*targs->n,
+                  targs->c + first*targs->m*targs->n, targs->m, targs->k, targs->n, num);
+
+    return NULL;
+}
+
+static void run_batch(small_kernel kernel, const int *a, const int *b, int *c,
+                      int m, int k, int n, long count, int num_threads)
+{
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+    if (num_threads > count)
+    {
+        num_threads = count > 0 ? count : 1;
+    }
+
+    small_args *targs = (small_args *)malloc(num_threads*sizeof(small_args));
+    pthread_t *tids = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    if (targs == NULL || tids == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int i=0; i<num_threads; ++i)
+    {
+        targs[i].id = i;
+        targs[i].t_num = num_threads;
+        targs[i].kernel = kernel;
+        targs[i].a = (const unsigned *)a;
+        targs[i].b = (const unsigned *)b;
+        targs[i].c = (unsigned *)c;
+        targs[i].m = m;
+        targs[i].k = k;
+        targs[i].n = n;
+        targs[i].count = count;
+    }
+
+    // one thread needs no pthread at all, which matters for small batches
+    if (num_threads == 1)
+    {
+        small_batch_main(&targs[0]);
+    }
+    else
+    {
+        for (int i=0; i<num_threads; ++i)
+        {
+            if (pthread_create(&tids[i], NULL, small_batch_main, &targs[i]) != 0)
+            {
+                perror("pthread_create");
+                exit(1);
+            }
+        }
+        for (int i=0; i<num_threads; ++i)
+        {
+            if (pthread_join(tids[i], NULL) != 0)
+            {
+                perror("pthread_join");
+                exit(1);
+            }
+        }
+    }
+
+    free(targs);
+    free(tids);
+}
+
+void small_multiply_batch(const int *a, const int *b, int *c,
+                          int m, int k, int n, long count, int num_threads)
+{
+    small_kernel kernel = kernel_for(m, k, n);
+    run_batch(kernel != NULL ? kernel : small_kernel_generic,
+              a, b, c, m, k, n, count, num_threads);
+}
+
+void small_multiply_batch_generic(const int *a, const int *b, int *c,
+                                  int m, int k, int n, long count, int num_threads)
+{
+    run_batch(small_kernel_generic, a, b, c, m, k, n, count, num_threads);
+}
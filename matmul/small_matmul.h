@@ -0,0 +1,25 @@
+#ifndef SMALL_MATMUL_H
+#define SMALL_MATMUL_H
+
+// Products of tiny matrices.  A batch keeps its matrices back to back in
+// one array, row-major with no row pointers: matrix i of a batch of m x k
+// matrices starts at a + i*m*k.  The shapes listed in small_matmul.c get a
+// kernel with compile-time bounds, unrolled so that a row of the result
+// stays in registers; every other shape falls back to a generic loop.
+
+// 1 if m x k times k x n has a specialized kernel
+int small_kernel_specialized(int m, int k, int n);
+
+// c = a * b for one contiguous product; returns 0, leaving c untouched, if
+// the shape has no specialized kernel
+int small_multiply(const int *a, const int *b, int *c, int m, int k, int n);
+
+// c[i] = a[i] * b[i] for count contiguous products, split across threads
+void small_multiply_batch(const int *a, const int *b, int *c,
+                          int m, int k, int n, long count, int num_threads);
+
+// the same with the generic loop for every shape, as a baseline
+void small_multiply_batch_generic(const int *a, const int *b, int *c,
+                                  int m, int k, int n, long count, int num_threads);
+
+#endif
@@ -0,0 +1,643 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+
+#include "sparse.h"
+
+// Products are accumulated in unsigned ints so that overflow wraps the same
+// way the dense kernel does; skipping zeros then leaves results bit-exact.
+
+typedef struct _spmm_args
+{
+    int id;
+    int t_num;
+    sparse_matrix *a;
+    matrix *da;         // dense left operand of dense_sparse_multiply
+    matrix *b;
+    sparse_matrix *sb;
+    matrix *c;
+    sparse_matrix *sc;
+    long *row_nnz;
+} spmm_args;
+
+sparse_matrix *alloc_sparse_matrix(int layout, int rows, int cols, long nnz)
+{
+    sparse_matrix *s = (sparse_matrix *)malloc(sizeof(sparse_matrix));
+    if (s == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    s->layout = layout;
+    s->num_rows = rows;
+    s->num_cols = cols;
+    s->nnz = nnz;
+
+    int major = layout == SPARSE_CSR ? rows : cols;
+    s->ptr = (long *)calloc(major+1, sizeof(long));
+    s->idx = (int *)malloc((nnz > 0 ? nnz : 1)*sizeof(int));
+    s->values = (int *)malloc((nnz > 0 ? nnz : 1)*sizeof(int));
+    if (s->ptr == NULL || s->idx == NULL || s->values == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    return s;
+}
+
+int is_matrix_market_file(char *fname)
+{
+    FILE *mfile = fopen(fname, "r");
+    if (mfile == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    char banner[15];
+    int mm = fread(banner, 1, sizeof(banner), mfile) == sizeof(banner)
+        && strncasecmp(banner, "%%MatrixMarket ", sizeof(banner)) == 0;
+
+    fclose(mfile);
+    return mm;
+}
+
+// reads a Matrix Market "coordinate" file with integer or pattern entries
+// and general, symmetric or skew-symmetric structure into CSR
+sparse_matrix *read_sparse_matrix(char *fname)
+{
+    FILE *mfile = fopen(fname, "r");
+    if (mfile == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    char object[32], format[32], field[32], symmetry[32];
+    if (fscanf(mfile, "%%%%MatrixMarket %31s %31s %31s %31s",
+               object, format, field, symmetry) != 4
+        || strcasecmp(object, "matrix") != 0
+        || strcasecmp(format, "coordinate") != 0)
+    {
+        printf("Format error in %s\n", fname);
+        exit(1);
+    }
+
+    int pattern = strcasecmp(field, "pattern") == 0;
+    if (!pattern && strcasecmp(field, "integer") != 0)
+    {
+        printf("Unsupported element type in %s\n", fname);
+        exit(1);
+    }
+    int symmetric = strcasecmp(symmetry, "symmetric") == 0;
+    int skew = strcasecmp(symmetry, "skew-symmetric") == 0;
+    if (!symmetric && !skew && strcasecmp(symmetry, "general") != 0)
+    {
+        printf("Unsupported symmetry in %s\n", fname);
+        exit(1);
+    }
+
+    // skip the rest of the banner line and any comment lines
+    int ch;
+    while ((ch = fgetc(mfile)) != EOF && ch != '\n')
+    {
+    }
+    while ((ch = fgetc(mfile)) == '%')
+    {
+        while ((ch = fgetc(mfile)) != EOF && ch != '\n')
+        {
+        }
+    }
+    if (ch != EOF)
+    {
+        ungetc(ch, mfile);
+    }
+
+    int num_rows, num_cols;
+    long num_entries;
+    if (fscanf(mfile, "%d %d %ld", &num_rows, &num_cols, &num_entries) != 3)
+    {
+        printf("Format error in %s\n", fname);
+        exit(1);
+    }
+    if (num_rows < 1)
+    {
+        printf("Row value error in %s\n", fname);
+        exit(1);
+    }
+    if (num_cols < 1)
+    {
+        printf("Column value error in %s\n", fname);
+        exit(1);
+    }
+    if (num_entries < 0)
+    {
+        printf("Format error in %s\n", fname);
+        exit(1);
+    }
+
+    // read coordinates first, mirroring off-diagonal entries as needed
+    long cap = (symmetric || skew) ? 2*num_entries : num_entries;
+    int *rows = (int *)malloc((cap > 0 ? cap : 1)*sizeof(int));
+    int *cols = (int *)malloc((cap > 0 ? cap : 1)*sizeof(int));
+    int *vals = (int *)malloc((cap > 0 ? cap : 1)*sizeof(int));
+    if (rows == NULL || cols == NULL || vals == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    long nnz = 0;
+    for (long i=0; i<num_entries; ++i)
+    {
+        int r, c, v = 1;
+        if (fscanf(mfile, "%d %d", &r, &c) != 2
+            || (!pattern && fscanf(mfile, "%d", &v) != 1))
+        {
+            printf("Format error in %s\n", fname);
+            exit(1);
+        }
+        if (r < 1 || r > num_rows || c < 1 || c > num_cols)
+        {
+            printf("Index error in %s\n", fname);
+            exit(1);
+        }
+
+        rows[nnz] = r-1;
+        cols[nnz] = c-1;
+        vals[nnz] = v;
+        ++nnz;
+        if ((symmetric || skew) && r != c)
+        {
+            rows[nnz] = c-1;
+            cols[nnz] = r-1;
+            vals[nnz] = skew ? (int)(0u - (unsigned)v) : v;
+            ++nnz;
+        }
+    }
+    fclose(mfile);
+
+    // counting sort of the coordinates by row
+    sparse_matrix *s = alloc_sparse_matrix(SPARSE_CSR, num_rows, num_cols, nnz);
+    for (long i=0; i<nnz; ++i)
+    {
+        ++s->ptr[rows[i]+1];
+    }
+    for (int r=0; r<num_rows; ++r)
+    {
+        s->ptr[r+1] += s->ptr[r];
+    }
+    long *next = (long *)malloc(num_rows*sizeof(long));
+    if (next == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    memcpy(next, s->ptr, num_rows*sizeof(long));
+    for (long i=0; i<nnz; ++i)
+    {
+        long k = next[rows[i]]++;
+        s->idx[k] = cols[i];
+        s->values[k] = vals[i];
+    }
+
+    free(next);
+    free(rows);
+    free(cols);
+    free(vals);
+    return s;
+}
+
+sparse_matrix *sparse_from_dense(matrix *m, int layout)
+{
+    sparse_matrix *s = alloc_sparse_matrix(layout, m->num_rows, m->num_cols, matrix_nnz(m));
+
+    long k = 0;
+    if (layout == SPARSE_CSR)
+    {
+        for (int r=0; r<m->num_rows; ++r)
+        {
+            for (int c=0; c<m->num_cols; ++c)
+            {
+                if (m->data[r][c] != 0)
+                {
+                    s->idx[k] = c;
+                    s->values[k] = m->data[r][c];
+                    ++k;
+                }
+            }
+            s->ptr[r+1] = k;
+        }
+    }
+    else
+    {
+        for (int c=0; c<m->num_cols; ++c)
+        {
+            for (int r=0; r<m->num_rows; ++r)
+            {
+                if (m->data[r][c] != 0)
+                {
+                    s->idx[k] = r;
+                    s->values[k] = m->data[r][c];
+                    ++k;
+                }
+            }
+            s->ptr[c+1] = k;
+        }
+    }
+
+    return s;
+}
+
+// CSR -> CSC or CSC -> CSR of the same matrix
+sparse_matrix *sparse_convert(sparse_matrix *s)
+{
+    int layout = s->layout == SPARSE_CSR ? SPARSE_CSC : SPARSE_CSR;
+    int major = s->layout == SPARSE_CSR ? s->num_rows : s->num_cols;
+    int minor = s->layout == SPARSE_CSR ? s->num_cols : s->num_rows;
+
+    sparse_matrix *t = alloc_sparse_matrix(layout, s->num_rows, s->num_cols, s->nnz);
+    for (long k=0; k<s->nnz; ++k)
+    {
+        ++t->ptr[s->idx[k]+1];
+    }
+    for (int i=0; i<minor; ++i)
+    {
+        t->ptr[i+1] += t->ptr[i];
+    }
+
+    long *next = (long *)malloc((minor > 0 ? minor : 1)*sizeof(long));
+    if (next == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    memcpy(next, t->ptr, minor*sizeof(long));
+    for (int i=0; i<major; ++i)
+    {
+        for (long k=s->ptr[i]; k<s->ptr[i+1]; ++k)
+        {
+            long dst = next[s->idx[k]]++;
+            t->idx[dst] = i;
+            t->values[dst] = s->values[k];
+        }
+    }
+
+    free(next);
+    return t;
+}
+
+matrix *sparse_to_dense(sparse_matrix *s)
+{
+    matrix *m = alloc_matrix(s->num_rows, s->num_cols);
+    memset(m->storage, 0, (size_t)s->num_rows*s->num_cols*sizeof(int));
+
+    int major = s->layout == SPARSE_CSR ? s->num_rows : s->num_cols;
+    for (int i=0; i<major; ++i)
+    {
+        for (long k=s->ptr[i]; k<s->ptr[i+1]; ++k)
+        {
+            // duplicates add up, as they would in a product
+            int *dst = s->layout == SPARSE_CSR ? &m->data[i][s->idx[k]] : &m->data[s->idx[k]][i];
+            *dst = (int)((unsigned)*dst + (unsigned)s->values[k]);
+        }
+    }
+
+    return m;
+}
+
+long matrix_nnz(matrix *m)
+{
+    long nnz = 0;
+    for (int r=0; r<m->num_rows; ++r)
+    {
+        for (int c=0; c<m->num_cols; ++c)
+        {
+            nnz += m->data[r][c] != 0;
+        }
+    }
+    return nnz;
+}
+
+int prefer_sparse(long nnz, int rows, int cols)
+{
+    return nnz <= SPARSE_DENSITY_CUTOFF * ((double)rows*cols);
+}
+
+// split the rows of a between threads so each gets about the same number
+// of non-zeros rather than the same number of rows
+static void thread_rows(sparse_matrix *a, int id, int t_num, int *first, int *last)
+{
+    long lo_target = a->nnz * id / t_num;
+    long hi_target = a->nnz * (id+1) / t_num;
+
+    int lo = 0;
+    while (lo < a->num_rows && a->ptr[lo] < lo_target)
+    {
+        ++lo;
+    }
+    int hi = lo;
+    while (hi < a->num_rows && a->ptr[hi] < hi_target)
+    {
+        ++hi;
+    }
+
+    *first = lo;
+    *last = id == t_num-1 ? a->num_rows : hi;
+}
+
+static void run_spmm_threads(void *(*fn)(void *), spmm_args *proto, int num_threads)
+{
+    spmm_args *targs = (spmm_args *)malloc(num_threads*sizeof(spmm_args));
+    pthread_t *tids = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    if (targs == NULL || tids == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int i=0; i<num_threads; ++i)
+    {
+        targs[i] = *proto;
+        targs[i].id = i;
+        targs[i].t_num = num_threads;
+
+        if (pthread_create(&tids[i], NULL, fn, &targs[i]) != 0)
+        {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (int i=0; i<num_threads; ++i)
+    {
+        if (pthread_join(tids[i], NULL) != 0)
+        {
+            perror("pthread_join");
+            exit(1);
+        }
+    }
+
+    free(targs);
+    free(tids);
+}
+
+static void *sparse_dense_main(void *arg)
+{
+    spmm_args *targs = (spmm_args *)arg;
+    sparse_matrix *a = targs->a;
+    matrix *b = targs->b;
+    int cols = b->num_cols;
+
+    int first, last;
+    thread_rows(a, targs->id, targs->t_num, &first, &last);
+
+    for (int r=first; r<last; ++r)
+    {
+        unsigned *c_row = (unsigned *)targs->c->data[r];
+        memset(c_row, 0, cols*sizeof(unsigned));
+        for (long k=a->ptr[r]; k<a->ptr[r+1]; ++k)
+        {
+            unsigned v = a->values[k];
+            const unsigned *b_row = (const unsigned *)b->data[a->idx[k]];
+            for (int j=0; j<cols; ++j)
+            {
+                c_row[j] += v * b_row[j];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+matrix *sparse_dense_multiply(sparse_matrix *a, matrix *b, int num_threads)
+{
+    if (a->layout != SPARSE_CSR || a->num_cols != b->num_rows)
+    {
+        printf("Matrix dimensions don't match!");
+        exit(1);
+    }
+
+    spmm_args proto;
+    memset(&proto, 0, sizeof(proto));
+    proto.a = a;
+    proto.b = b;
+    proto.c = alloc_matrix(a->num_rows, b->num_cols);
+
+    run_spmm_threads(sparse_dense_main, &proto, num_threads < 1 ? 1 : num_threads);
+
+    return proto.c;
+}
+
+// c = da * sb with sb in CSR: row r of c is the sum of the rows of sb
+// picked out by the non-zeros of row r of da, so the work is
+// rows * nnz(sb) rather than rows * cols * inner
+static void *dense_sparse_main(void *arg)
+{
+    spmm_args *targs = (spmm_args *)arg;
+    matrix *a = targs->da;
+    sparse_matrix *b = targs->sb;
+    int cols = b->num_cols;
+
+    // divide rows as equally as possible across threads
+    int min_rows_per_thread = a->num_rows / targs->t_num;
+    int extra_rows = a->num_rows % targs->t_num;
+
+    int first = min_rows_per_thread * targs->id;
+    int last = first + min_rows_per_thread;
+    if (extra_rows > targs->id)
+    {
+        first += targs->id;
+        last += targs->id + 1;
+    }
+    else
+    {
+        first += extra_rows;
+        last += extra_rows;
+    }
+
+    for (int r=first; r<last; ++r)
+    {
+        unsigned *c_row = (unsigned *)targs->c->data[r];
+        const unsigned *a_row = (const unsigned *)a->data[r];
+        memset(c_row, 0, cols*sizeof(unsigned));
+        for (int k=0; k<a->num_cols; ++k)
+        {
+            unsigned v = a_row[k];
+            if (v == 0)
+            {
+                continue;
+            }
+            for (long p=b->ptr[k]; p<b->ptr[k+1]; ++p)
+            {
+                c_row[b->idx[p]] += v * (unsigned)b->values[p];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+matrix *dense_sparse_multiply(matrix *a, sparse_matrix *b, int num_threads)
+{
+    if (b->layout != SPARSE_CSR || a->num_cols != b->num_rows)
+    {
+        printf("Matrix dimensions don't match!");
+        exit(1);
+    }
+
+    spmm_args proto;
+    memset(&proto, 0, sizeof(proto));
+    proto.da = a;
+    proto.sb = b;
+    proto.c = alloc_matrix(a->num_rows, b->num_cols);
+
+    run_spmm_threads(dense_sparse_main, &proto, num_threads < 1 ? 1 : num_threads);
+
+    return proto.c;
+}
+
+// Gustavson's row-by-row algorithm: pass 0 counts the distinct columns of
+// each output row, pass 1 fills them in at offsets from the prefix sum
+static void gustavson_rows(spmm_args *targs, int pass)
+{
+    sparse_matrix *a = targs->a;
+    sparse_matrix *b = targs->sb;
+    sparse_matrix *c = targs->sc;
+
+    int first, last;
+    thread_rows(a, targs->id, targs->t_num, &first, &last);
+
+    // marker[j] holds the output position of column j in the current row,
+    // or -1; acc holds the running sums in pass 1
+    long *marker = (long *)malloc(b->num_cols*sizeof(long));
+    unsigned *acc = (unsigned *)malloc(b->num_cols*sizeof(unsigned));
+    if (marker == NULL || acc == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    for (int j=0; j<b->num_cols; ++j)
+    {
+        marker[j] = -1;
+    }
+
+    for (int r=first; r<last; ++r)
+    {
+        long row_start = pass == 0 ? 0 : c->ptr[r];
+        long n = 0;
+        for (long ka=a->ptr[r]; ka<a->ptr[r+1]; ++ka)
+        {
+            unsigned v = a->values[ka];
+            int k = a->idx[ka];
+            for (long kb=b->ptr[k]; kb<b->ptr[k+1]; ++kb)
+            {
+                int j = b->idx[kb];
+                if (marker[j] < 0)
+                {
+                    marker[j] = n++;
+                    acc[j] = 0;
+                    if (pass == 1)
+                    {
+                        c->idx[row_start + marker[j]] = j;
+                    }
+                }
+                acc[j] += v * (unsigned)b->values[kb];
+            }
+        }
+
+        if (pass == 0)
+        {
+            targs->row_nnz[r] = n;
+            for (long ka=a->ptr[r]; ka<a->ptr[r+1]; ++ka)
+            {
+                int k = a->idx[ka];
+                for (long kb=b->ptr[k]; kb<b->ptr[k+1]; ++kb)
+                {
+                    marker[b->idx[kb]] = -1;
+                }
+            }
+        }
+        else
+        {
+            for (long i=0; i<n; ++i)
+            {
+                int j = c->idx[row_start + i];
+                c->values[row_start + i] = (int)acc[j];
+                marker[j] = -1;
+            }
+        }
+    }
+
+    free(marker);
+    free(acc);
+}
+
+static void *sparse_count_main(void *arg)
+{
+    gustavson_rows((spmm_args *)arg, 0);
+    return NULL;
+}
+
+static void *sparse_fill_main(void *arg)
+{
+    gustavson_rows((spmm_args *)arg, 1);
+    return NULL;
+}
+
+sparse_matrix *sparse_sparse_multiply(sparse_matrix *a, sparse_matrix *b, int num_threads)
+{
+    if (a->layout != SPARSE_CSR || b->layout != SPARSE_CSR || a->num_cols != b->num_rows)
+    {
+        printf("Matrix dimensions don't match!");
+        exit(1);
+    }
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    spmm_args proto;
+    memset(&proto, 0, sizeof(proto));
+    proto.a = a;
+    proto.sb = b;
+    proto.row_nnz = (long *)malloc(a->num_rows*sizeof(long));
+    if (proto.row_nnz == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    run_spmm_threads(sparse_count_main, &proto, num_threads);
+
+    long nnz = 0;
+    for (int r=0; r<a->num_rows; ++r)
+    {
+        nnz += proto.row_nnz[r];
+    }
+
+    sparse_matrix *c = alloc_sparse_matrix(SPARSE_CSR, a->num_rows, b->num_cols, nnz);
+    for (int r=0; r<a->num_rows; ++r)
+    {
+        c->ptr[r+1] = c->ptr[r] + proto.row_nnz[r];
+    }
+    proto.sc = c;
+
+    run_spmm_threads(sparse_fill_main, &proto, num_threads);
+
+    free(proto.row_nnz);
+    return c;
+}
+
+void free_sparse_matrix(sparse_matrix *s)
+{
+    free(s->ptr);
+    free(s->idx);
+    free(s->values);
+    free(s);
+}
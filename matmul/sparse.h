@@ -0,0 +1,39 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include "matrix.h"
+
+// below this fraction of non-zeros the sparse kernels beat the dense one
+#define SPARSE_DENSITY_CUTOFF 0.10
+
+#define SPARSE_CSR 0
+#define SPARSE_CSC 1
+
+// Compressed sparse matrix.  For CSR, ptr has num_rows+1 entries and
+// idx/values for row r live in [ptr[r], ptr[r+1]) with idx holding column
+// numbers; CSC is the same with the roles of rows and columns swapped.
+typedef struct _sparse_matrix
+{
+    int layout;
+    int num_rows;
+    int num_cols;
+    long nnz;
+    long *ptr;
+    int *idx;
+    int *values;
+} sparse_matrix;
+
+sparse_matrix *alloc_sparse_matrix(int layout, int rows, int cols, long nnz);
+int is_matrix_market_file(char *fname);
+sparse_matrix *read_sparse_matrix(char *fname);
+sparse_matrix *sparse_from_dense(matrix *m, int layout);
+sparse_matrix *sparse_convert(sparse_matrix *s);
+matrix *sparse_to_dense(sparse_matrix *s);
+long matrix_nnz(matrix *m);
+int prefer_sparse(long nnz, int rows, int cols);
+matrix *sparse_dense_multiply(sparse_matrix *a, matrix *b, int num_threads);
+matrix *dense_sparse_multiply(matrix *a, sparse_matrix *b, int num_threads);
+sparse_matrix *sparse_sparse_multiply(sparse_matrix *a, sparse_matrix *b, int num_threads);
+void free_sparse_matrix(sparse_matrix *s);
+
+#endif
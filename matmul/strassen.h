@@ -0,0 +1,11 @@
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+#include "matrix.h"
+
+// sub-problems of this size or smaller use the blocked classic kernel
+#define STRASSEN_DEFAULT_CUTOFF 128
+
+matrix *strassen_multiply_matrix(matrix *m1, matrix *m2, int cutoff, int num_threads);
+
+#endif
@@ -0,0 +1,600 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <float.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "typed_matrix.h"
+
+// Each element type gets its own kernel, reader, printer and result check,
+// stamped out by the macros below, so the dtype is looked up once per call
+// and never per element.  Columns: dtype, name, element type, arithmetic
+// type, product dtype, I/O type, scanf format, printf format, the range of
+// values the element type can hold, the type results are checked in and
+// its rounding unit (0 for an exact check).  Integer products use unsigned
+// arithmetic so overflow wraps like the int kernel does.
+#define FOR_EACH_DTYPE(X) \
+    X(MATRIX_DTYPE_INT8,   int8,   int8_t,  uint32_t, MATRIX_DTYPE_INT32,  long long, "%lld", "%*lld",  INT8_MIN,  INT8_MAX,  uint32_t, 0)           \
+    X(MATRIX_DTYPE_INT16,  int16,  int16_t, uint32_t, MATRIX_DTYPE_INT32,  long long, "%lld", "%*lld",  INT16_MIN, INT16_MAX, uint32_t, 0)           \
+    X(MATRIX_DTYPE_INT32,  int32,  int32_t, uint32_t, MATRIX_DTYPE_INT32,  long long, "%lld", "%*lld",  INT32_MIN, INT32_MAX, uint32_t, 0)           \
+    X(MATRIX_DTYPE_INT64,  int64,  int64_t, uint64_t, MATRIX_DTYPE_INT64,  long long, "%lld", "%*lld",  LLONG_MIN, LLONG_MAX, uint64_t, 0)           \
+    X(MATRIX_DTYPE_FLOAT,  float,  float,   float,    MATRIX_DTYPE_FLOAT,  double,    "%lf",  "%*.9g",  -FLT_MAX,  FLT_MAX,   double,   FLT_EPSILON) \
+    X(MATRIX_DTYPE_DOUBLE, double, double,  double,   MATRIX_DTYPE_DOUBLE, double,    "%lf",  "%*.17g", -DBL_MAX,  DBL_MAX,   double,   DBL_EPSILON)
+
+#define CHECK_ABS(x) ((x) < 0 ? -(x) : (x))
+
+typedef struct _dtype_ops
+{
+    uint32_t dtype;
+    const char *name;
+    uint32_t out_dtype;
+    // rows [first, last) of c = a * b; c is of the product dtype
+    void (*kernel)(const void *a, const void *b, void *c, int inner, int cols, int first, int last);
+    int (*read_elems)(FILE *mfile, void *data, size_t n);
+    void (*print)(FILE *out, const void *data, int rows, int cols);
+
+    // Freivalds' check of c = a * b, in the check type: fill_random draws
+    // r, project computes rows [first, last) of y = b * r and of |b| * r,
+    // and compare counts the entries of rows [first, last) of a * y and
+    // c * r that differ by more than rounding can explain
+    size_t check_size;
+    void (*fill_random)(void *r, size_t n, unsigned int *seed);
+    void (*project)(const void *b, const void *r, void *y, void *y_abs,
+                    int cols, int rounds, int first, int last);
+    long (*compare)(const void *a, const void *c, const void *r, const void *y,
+                    const void *y_abs, int inner, int cols, int rounds, int first, int last);
+} dtype_ops;
+
+typedef struct _typed_thread_args
+{
+    int id;
+    int t_num;
+    const dtype_ops *ops;
+    typed_matrix *m1;
+    typed_matrix *m2;
+    typed_matrix *m3;
+} typed_thread_args;
+
+typedef struct _typed_verify_args
+{
+    int id;
+    int t_num;
+    const dtype_ops *ops;
+    typed_matrix *a;
+    typed_matrix *b;
+    typed_matrix *c;
+    void *r;
+    void *y;
+    void *y_abs;
+    int rounds;
+    int phase;          // 0: project b, 1: compare against c
+    long mismatches;
+} typed_verify_args;
+
+#define DEFINE_DTYPE_FUNCS(dt, name, elem_t, acc_t, out_dt, io_t, scan_fmt, print_fmt, lo, hi, check_t, eps) \
+static void kernel_##name(const void *a_, const void *b_, void *c_,             \
+                          int inner, int cols, int first, int last)              \
+{                                                                                \
+    const elem_t *a = (const elem_t *)a_;                                        \
+    const elem_t *b = (const elem_t *)b_;                                        \
+    acc_t *c = (acc_t *)c_;                                                      \
+    for (int r=first; r<last; ++r)                                               \
+    {                                                                            \
+        acc_t *restrict c_row = c + (size_t)r*cols;                              \
+        for (int j=0; j<cols; ++j)                                               \
+        {                                                                        \
+            c_row[j] = 0;                                                        \
+        }                                                                        \
+        for (int k=0; k<inner; ++k)                                              \
+        {                                                                        \
+            acc_t a_rk = (acc_t)a[(size_t)r*inner + k];                          \
+            const elem_t *restrict b_row = b + (size_t)k*cols;                   \
+            for (int j=0; j<cols; ++j)                                           \
+            {                                                                    \
+                c_row[j] += a_rk * (acc_t)b_row[j];                              \
+            }                                                                    \
+        }                                                                        \
+    }                                                                            \
+}                                                                                \
+                                                                                 \
+static int read_##name(FILE *mfile, void *data_, size_t n)                       \
+{                                                                                \
+    elem_t *data = (elem_t *)data_;                                              \
+    for (size_t i=0; i<n; ++i)                                                   \
+    {                                                                            \
+        io_t v;                                                                  \
+        /* a value that does not fit is as wrong as one that does not parse */  \
+        if (fscanf(mfile, scan_fmt, &v) != 1 || v < lo || v > hi)                \
+        {                                                                        \
+            return 0;                                                            \
+        }                                                                        \
+        data[i] = (elem_t)v;                                                     \
+    }                                                                            \
+    return 1;                                                                    \
+}                                                                                \
+                                                                                 \
+static void print_##name(FILE *out, const void *data_, int rows, int cols)       \
+{                                                                                \
+    const elem_t *data = (const elem_t *)data_;                                  \
+    size_t n = (size_t)rows*cols;                                                \
+    int longest = 0;                                                             \
+    for (size_t i=0; i<n; ++i)                                                   \
+    {                                                                            \
+        int len = snprintf(NULL, 0, print_fmt, 0, (io_t)data[i]);                \
+        longest = len > longest ? len : longest;                                 \
+    }                                                                            \
+    fprintf(out, "%d\n%d\n", rows, cols);                                        \
+    for (int r=0; r<rows; ++r)                                                   \
+    {                                                                            \
+        for (int c=0; c<cols; ++c)                                               \
+        {                                                                        \
+            fprintf(out, print_fmt, longest+1, (io_t)data[(size_t)r*cols + c]);  \
+        }                                                                        \
+        fprintf(out, "\n");                                                      \
+    }                                                                            \
+}                                                                                \
+                                                                                 \
+/* full-width integers; floats in [0, 1), so that |a| |b| r bounds rounding */   \
+static void fill_random_##name(void *r_, size_t n, unsigned int *seed)           \
+{                                                                                \
+    check_t *r = (check_t *)r_;                                                  \
+    for (size_t i=0; i<n; ++i)                                                   \
+    {                                                                            \
+        uint64_t bits = (uint64_t)rand_r(seed) << 42;                            \
+        bits ^= (uint64_t)rand_r(seed) << 21;                                    \
+        bits ^= (uint64_t)rand_r(seed);                                          \
+        r[i] = eps > 0 ? (check_t)(bits % 1000000 / 1000000.0) : (check_t)bits;  \
+    }                                                                            \
+}                                                                                \
+                                                                                 \
+static void project_##name(const void *b_, const void *r_, void *y_,             \
+                           void *y_abs_, int cols, int rounds, int first,        \
+                           int last)                                             \
+{                                                                                \
+    const elem_t *b = (const elem_t *)b_;                                        \
+    const check_t *r = (const check_t *)r_;                                      \
+    for (int k=first; k<last; ++k)                                               \
+    {                                                                            \
+        check_t *y_row = (check_t *)y_ + (size_t)k*rounds;                       \
+        check_t *y_abs_row = (check_t *)y_abs_ + (size_t)k*rounds;               \
+        for (int t=0; t<rounds; ++t)                                             \
+        {                                                                        \
+            y_row[t] = 0;                                                        \
+            y_abs_row[t] = 0;                                                    \
+        }                                                                        \
+        for (int j=0; j<cols; ++j)                                               \
+        {                                                                        \
+            check_t b_kj = (check_t)b[(size_t)k*cols + j];                       \
+            const check_t *r_row = r + (size_t)j*rounds;                         \
+            for (int t=0; t<rounds; ++t)                                         \
+            {                                                                    \
+                y_row[t] += b_kj * r_row[t];                                     \
+                if (eps > 0)                                                     \
+                {                                                                \
+                    y_abs_row[t] += CHECK_ABS(b_kj) * r_row[t];                  \
+                }                                                                \
+            }                                                                    \
+        }                                                                        \
+    }                                                                            \
+}                                                                                \
+                                                                                 \
+/* c holds products, which the kernel stores as acc_t */                         \
+static long compare_##name(const void *a_, const void *c_, const void *r_,       \
+                           const void *y_, const void *y_abs_, int inner,        \
+                           int cols, int rounds, int first, int last)            \
+{                                                                                \
+    const elem_t *a = (const elem_t *)a_;                                        \
+    const acc_t *c = (const acc_t *)c_;                                          \
+    const check_t *r = (const check_t *)r_;                                      \
+    const check_t *y = (const check_t *)y_;                                      \
+    const check_t *y_abs = (const check_t *)y_abs_;                              \
+    long mismatches = 0;                                                         \
+    for (int i=first; i<last; ++i)                                               \
+    {                                                                            \
+        for (int t=0; t<rounds; ++t)                                             \
+        {                                                                        \
+            check_t ay = 0, ay_abs = 0, cr = 0;                                  \
+            for (int k=0; k<inner; ++k)                                          \
+            {                                                                    \
+                check_t a_ik = (check_t)a[(size_t)i*inner + k];                  \
+                ay += a_ik * y[(size_t)k*rounds + t];                            \
+                if (eps > 0)                                                     \
+                {                                                                \
+                    ay_abs += CHECK_ABS(a_ik) * y_abs[(size_t)k*rounds + t];     \
+                }                                                                \
+            }                                                                    \
+            for (int j=0; j<cols; ++j)                                           \
+            {                                                                    \
+                cr += (check_t)c[(size_t)i*cols + j] * r[(size_t)j*rounds + t];  \
+            }                                                                    \
+            /* a float dot product may be off by its length in half ulps */      \
+            /* of the sum of its magnitudes; integers must match exactly */      \
+            check_t diff = ay - cr;                                              \
+            check_t bound = eps*(inner + cols)*ay_abs;                           \
+            if (eps > 0 ? CHECK_ABS(diff) > bound : diff != 0)                   \
+            {                                                                    \
+                ++mismatches;                                                    \
+            }                                                                    \
+        }                                                                        \
+    }                                                                            \
+    return mismatches;                                                           \
+}
+
+FOR_EACH_DTYPE(DEFINE_DTYPE_FUNCS)
+
+#define DTYPE_OPS_ENTRY(dt, name, elem_t, acc_t, out_dt, io_t, scan_fmt, print_fmt, lo, hi, check_t, eps) \
+    { dt, #name, out_dt, kernel_##name, read_##name, print_##name,               \
+      sizeof(check_t), fill_random_##name, project_##name, compare_##name },
+
+static const dtype_ops all_dtype_ops[] = {
+    FOR_EACH_DTYPE(DTYPE_OPS_ENTRY)
+};
+
+static const dtype_ops *ops_for(uint32_t dtype)
+{
+    for (size_t i=0; i<sizeof(all_dtype_ops)/sizeof(all_dtype_ops[0]); ++i)
+    {
+        if (all_dtype_ops[i].dtype == dtype)
+        {
+            return &all_dtype_ops[i];
+        }
+    }
+    printf("Unsupported element type %u\n", dtype);
+    exit(1);
+}
+
+uint32_t dtype_from_name(const char *name)
+{
+    for (size_t i=0; i<sizeof(all_dtype_ops)/sizeof(all_dtype_ops[0]); ++i)
+    {
+        if (strcmp(all_dtype_ops[i].name, name) == 0)
+        {
+            return all_dtype_ops[i].dtype;
+        }
+    }
+    return 0;
+}
+
+const char *dtype_name(uint32_t dtype)
+{
+    return ops_for(dtype)->name;
+}
+
+uint32_t product_dtype(uint32_t dtype)
+{
+    return ops_for(dtype)->out_dtype;
+}
+
+typed_matrix *alloc_typed_matrix(uint32_t dtype, int rows, int cols)
+{
+    typed_matrix *m = (typed_matrix *)malloc(sizeof(typed_matrix));
+    if (m == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    m->dtype = dtype;
+    m->num_rows = rows;
+    m->num_cols = cols;
+    m->map = NULL;
+    m->map_len = 0;
+
+    m->data = malloc((size_t)rows*cols*dtype_size(dtype));
+    if (m->data == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    return m;
+}
+
+// binary files are mapped in place and must already hold dtype elements;
+// text files are parsed into dtype.  A dtype of 0 means whatever a binary
+// file holds, or int32 for text.
+typed_matrix *read_typed_matrix(char *fname, uint32_t dtype)
+{
+    if (is_binary_matrix_file(fname))
+    {
+        size_t len;
+        void *map = map_matrix_file(fname, &len);
+        matrix_bin_header *hdr = (matrix_bin_header *)map;
+        if (dtype == 0)
+        {
+            dtype = hdr->dtype;
+        }
+        const dtype_ops *ops = ops_for(dtype);
+        if (hdr->dtype != dtype)
+        {
+            printf("Element type mismatch in %s: file is %s, expected %s\n",
+                   fname, dtype_name(hdr->dtype), ops->name);
+            exit(1);
+        }
+
+        typed_matrix *m = (typed_matrix *)malloc(sizeof(typed_matrix));
+        if (m == NULL)
+        {
+            perror("malloc");
+            exit(1);
+        }
+        m->dtype = dtype;
+        m->num_rows = hdr->num_rows;
+        m->num_cols = hdr->num_cols;
+        m->data = (char *)map + hdr->data_offset;
+        m->map = map;
+        m->map_len = len;
+        return m;
+    }
+
+    const dtype_ops *ops = ops_for(dtype == 0 ? MATRIX_DTYPE_INT32 : dtype);
+
+    FILE *mfile = fopen(fname, "r");
+    if (mfile == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    int num_rows, num_cols;
+    if (fscanf(mfile, "%d\n%d\n", &num_rows, &num_cols) != 2)
+    {
+        printf("Format error in %s\n", fname);
+        exit(1);
+    }
+    if (num_rows < 1)
+    {
+        printf("Row value error in %s\n", fname);
+        exit(1);
+    }
+    if (num_cols < 1)
+    {
+        printf("Column value error in %s\n", fname);
+        exit(1);
+    }
+
+    typed_matrix *m = alloc_typed_matrix(ops->dtype, num_rows, num_cols);
+    if (!ops->read_elems(mfile, m->data, (size_t)num_rows*num_cols))
+    {
+        printf("Format error in %s\n", fname);
+        exit(1);
+    }
+
+    fclose(mfile);
+    return m;
+}
+
+void write_typed_matrix_binary(typed_matrix *m, char *fname)
+{
+    write_matrix_file(fname, m->dtype, m->num_rows, m->num_cols, m->data);
+}
+
+static void *typed_thread_main(void *arg)
+{
+    typed_thread_args *targs = (typed_thread_args *)arg;
+
+    // divide rows as equally as possible across threads
+    int min_rows_per_thread = targs->m1->num_rows / targs->t_num;
+    int extra_rows = targs->m1->num_rows % targs->t_num;
+
+    int my_start_row = min_rows_per_thread * targs->id;
+    int my_num_rows = min_rows_per_thread;
+    if (extra_rows > targs->id)
+    {
+        my_start_row += targs->id;
+        ++my_num_rows;
+    }
+    else
+    {
+        my_start_row += extra_rows;
+    }
+
+    targs->ops->kernel(targs->m1->data, targs->m2->data, targs->m3->data,
+                       targs->m1->num_cols, targs->m2->num_cols,
+                       my_start_row, my_start_row + my_num_rows);
+
+    return NULL;
+}
+
+typed_matrix *typed_multiply(typed_matrix *m1, typed_matrix *m2, int num_threads)
+{
+    if (m1->num_cols != m2->num_rows || m1->dtype != m2->dtype)
+    {
+        printf("Matrix dimensions don't match!");
+        exit(1);
+    }
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    const dtype_ops *ops = ops_for(m1->dtype);
+    typed_matrix *res = alloc_typed_matrix(ops->out_dtype, m1->num_rows, m2->num_cols);
+
+    typed_thread_args *targs = (typed_thread_args *)malloc(num_threads*sizeof(typed_thread_args));
+    pthread_t *tids = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    if (targs == NULL || tids == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int i=0; i<num_threads; ++i)
+    {
+        targs[i].id = i;
+        targs[i].t_num = num_threads;
+        targs[i].ops = ops;
+        targs[i].m1 = m1;
+        targs[i].m2 = m2;
+        targs[i].m3 = res;
+
+        if (pthread_create(&tids[i], NULL, typed_thread_main, &targs[i]) != 0)
+        {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+
+    for (int i=0; i<num_threads; ++i)
+    {
+        if (pthread_join(tids[i], NULL) != 0)
+        {
+            perror("pthread_join");
+            exit(1);
+        }
+    }
+
+    free(targs);
+    free(tids);
+    return res;
+}
+
+static void *typed_verify_main(void *arg)
+{
+    typed_verify_args *vargs = (typed_verify_args *)arg;
+    int num_rows = vargs->phase == 0 ? vargs->b->num_rows : vargs->a->num_rows;
+
+    // divide rows as equally as possible across threads
+    int min_rows_per_thread = num_rows / vargs->t_num;
+    int extra_rows = num_rows % vargs->t_num;
+
+    int my_start_row = min_rows_per_thread * vargs->id;
+    int my_num_rows = min_rows_per_thread;
+    if (extra_rows > vargs->id)
+    {
+        my_start_row += vargs->id;
+        ++my_num_rows;
+    }
+    else
+    {
+        my_start_row += extra_rows;
+    }
+
+    if (vargs->phase == 0)
+    {
+        vargs->ops->project(vargs->b->data, vargs->r, vargs->y, vargs->y_abs,
+                            vargs->b->num_cols, vargs->rounds,
+                            my_start_row, my_start_row + my_num_rows);
+    }
+    else
+    {
+        vargs->mismatches = vargs->ops->compare(vargs->a->data, vargs->c->data, vargs->r,
+                                                vargs->y, vargs->y_abs, vargs->a->num_cols,
+                                                vargs->c->num_cols, vargs->rounds,
+                                                my_start_row, my_start_row + my_num_rows);
+    }
+
+    return NULL;
+}
+
+static void run_verify_phase(typed_verify_args *vargs, pthread_t *tids, int phase, int num_threads)
+{
+    for (int i=0; i<num_threads; ++i)
+    {
+        vargs[i].phase = phase;
+        if (pthread_create(&tids[i], NULL, typed_verify_main, &vargs[i]) != 0)
+        {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (int i=0; i<num_threads; ++i)
+    {
+        if (pthread_join(tids[i], NULL) != 0)
+        {
+            perror("pthread_join");
+            exit(1);
+        }
+    }
+}
+
+int typed_freivalds_verify(typed_matrix *a, typed_matrix *b, typed_matrix *c, int rounds,
+                           int num_threads, unsigned int seed)
+{
+    if (a->dtype != b->dtype || c->dtype != product_dtype(a->dtype) || a->num_cols != b->num_rows
+        || c->num_rows != a->num_rows || c->num_cols != b->num_cols)
+    {
+        return 0;
+    }
+    if (rounds < 1)
+    {
+        rounds = 1;
+    }
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    const dtype_ops *ops = ops_for(a->dtype);
+    void *r = malloc((size_t)b->num_cols*rounds*ops->check_size);
+    void *y = malloc((size_t)b->num_rows*rounds*ops->check_size);
+    void *y_abs = malloc((size_t)b->num_rows*rounds*ops->check_size);
+    typed_verify_args *vargs = (typed_verify_args *)malloc(num_threads*sizeof(typed_verify_args));
+    pthread_t *tids = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    if (r == NULL || y == NULL || y_abs == NULL || vargs == NULL || tids == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    ops->fill_random(r, (size_t)b->num_cols*rounds, &seed);
+
+    for (int i=0; i<num_threads; ++i)
+    {
+        vargs[i].id = i;
+        vargs[i].t_num = num_threads;
+        vargs[i].ops = ops;
+        vargs[i].a = a;
+        vargs[i].b = b;
+        vargs[i].c = c;
+        vargs[i].r = r;
+        vargs[i].y = y;
+        vargs[i].y_abs = y_abs;
+        vargs[i].rounds = rounds;
+        vargs[i].mismatches = 0;
+    }
+
+    // every row of y is needed by every row of the comparison
+    run_verify_phase(vargs, tids, 0, num_threads);
+    run_verify_phase(vargs, tids, 1, num_threads);
+
+    long mismatches = 0;
+    for (int i=0; i<num_threads; ++i)
+    {
+        mismatches += vargs[i].mismatches;
+    }
+
+    free(r);
+    free(y);
+    free(y_abs);
+    free(vargs);
+    free(tids);
+    return mismatches == 0;
+}
+
+void fprint_typed_matrix(FILE *out, typed_matrix *m)
+{
+    ops_for(m->dtype)->print(out, m->data, m->num_rows, m->num_cols);
+}
+
+void print_typed_matrix(typed_matrix *m)
+{
+    fprint_typed_matrix(stdout, m);
+}
+
+void free_typed_matrix(typed_matrix *m)
+{
+    if (m->map != NULL)
+    {
+        munmap(m->map, m->map_len);
+    }
+    else
+    {
+        free(m->data);
+    }
+    free(m);
+}
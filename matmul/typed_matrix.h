@@ -0,0 +1,40 @@
+#ifndef TYPED_MATRIX_H
+#define TYPED_MATRIX_H
+
+#include "matrix.h"
+
+// A matrix of any MATRIX_DTYPE_* element type, stored contiguously in
+// row-major order.  Products of int8/int16/int32 matrices are int32, int64
+// products are int64 and float/double products keep their type.
+typedef struct _typed_matrix
+{
+    uint32_t dtype;
+    int num_rows;
+    int num_cols;
+    void *data;
+    void *map;          // non-NULL when data lives in an mmap'd file
+    size_t map_len;
+} typed_matrix;
+
+uint32_t dtype_from_name(const char *name);
+const char *dtype_name(uint32_t dtype);
+uint32_t product_dtype(uint32_t dtype);
+
+typed_matrix *alloc_typed_matrix(uint32_t dtype, int rows, int cols);
+typed_matrix *read_typed_matrix(char *fname, uint32_t dtype);
+void write_typed_matrix_binary(typed_matrix *m, char *fname);
+typed_matrix *typed_multiply(typed_matrix *m1, typed_matrix *m2, int num_threads);
+
+// Freivalds' check (see verify.h) that c == m1 * m2 for typed matrices.
+// Integer products are checked exactly, modulo 2^32 or 2^64 like the
+// kernels; float and double products pass if every entry of c * r is
+// within the rounding error the dot products can accumulate.  Returns 1
+// if c passed every round.
+int typed_freivalds_verify(typed_matrix *m1, typed_matrix *m2, typed_matrix *c, int rounds,
+                           int num_threads, unsigned int seed);
+
+void fprint_typed_matrix(FILE *out, typed_matrix *m);
+void print_typed_matrix(typed_matrix *m);
+void free_typed_matrix(typed_matrix *m);
+
+#endif
@@ -0,0 +1,217 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "verify.h"
+
+// all rounds are checked together: column t of r is the random vector of
+// round t, so every step is a gemm with a narrow right-hand side
+typedef struct _verify_args
+{
+    int id;
+    int t_num;
+    matrix *a;
+    matrix *b;
+    matrix *c;
+    freivalds_vectors *fv;
+    long mismatches;
+} verify_args;
+
+static void thread_rows(int id, int t_num, int num_rows, int *first, int *count)
+{
+    // divide rows as equally as possible across threads
+    int min_rows_per_thread = num_rows / t_num;
+    int extra_rows = num_rows % t_num;
+
+    *first = min_rows_per_thread * id;
+    *count = min_rows_per_thread;
+    if (extra_rows > id)
+    {
+        *first += id;
+        ++*count;
+    }
+    else
+    {
+        *first += extra_rows;
+    }
+}
+
+// rows [first, first+count) of m, sharing its storage
+static matrix row_view(matrix *m, int first, int count)
+{
+    matrix view = { m->data + first, count, m->num_cols, m->data[first], NULL, 0 };
+    return view;
+}
+
+static void run_threads(void *(*fn)(void *), verify_args *args, int num_threads)
+{
+    pthread_t *tids = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    if (tids == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int i=0; i<num_threads; ++i)
+    {
+        if (pthread_create(&tids[i], NULL, fn, &args[i]) != 0)
+        {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (int i=0; i<num_threads; ++i)
+    {
+        if (pthread_join(tids[i], NULL) != 0)
+        {
+            perror("pthread_join");
+            exit(1);
+        }
+    }
+
+    free(tids);
+}
+
+static verify_args *make_verify_args(matrix *a, matrix *b, matrix *c,
+                                     freivalds_vectors *fv, int num_threads)
+{
+    verify_args *vargs = (verify_args *)malloc(num_threads*sizeof(verify_args));
+    if (vargs == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i=0; i<num_threads; ++i)
+    {
+        vargs[i].id = i;
+        vargs[i].t_num = num_threads;
+        vargs[i].a = a;
+        vargs[i].b = b;
+        vargs[i].c = c;
+        vargs[i].fv = fv;
+        vargs[i].mismatches = 0;
+    }
+    return vargs;
+}
+
+// rows of y = b * r
+static void *project_main(void *arg)
+{
+    verify_args *vargs = (verify_args *)arg;
+
+    int first, count;
+    thread_rows(vargs->id, vargs->t_num, vargs->b->num_rows, &first, &count);
+    if (count > 0)
+    {
+        matrix b_rows = row_view(vargs->b, first, count);
+        matrix y_rows = row_view(vargs->fv->y, first, count);
+        gemm(GEMM_NO_TRANS, GEMM_NO_TRANS, 1, &b_rows, vargs->fv->r, 0, &y_rows);
+    }
+
+    return NULL;
+}
+
+// rows of a * y - c * r, which must all be zero
+static void *compare_main(void *arg)
+{
+    verify_args *vargs = (verify_args *)arg;
+
+    int first, count;
+    thread_rows(vargs->id, vargs->t_num, vargs->a->num_rows, &first, &count);
+    if (count > 0)
+    {
+        matrix a_rows = row_view(vargs->a, first, count);
+        matrix c_rows = row_view(vargs->c, first, count);
+        vargs->mismatches = freivalds_check_rows(vargs->fv, &a_rows, &c_rows);
+    }
+
+    return NULL;
+}
+
+freivalds_vectors *freivalds_prepare(matrix *b, int rounds, int num_threads,
+                                     unsigned int seed)
+{
+    if (rounds < 1)
+    {
+        rounds = 1;
+    }
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    freivalds_vectors *fv = (freivalds_vectors *)malloc(sizeof(freivalds_vectors));
+    if (fv == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    // two distinct values per entry are enough for the 1/2 bound; with
+    // full-width entries a wrong c almost never survives even one round
+    fv->r = alloc_matrix(b->num_cols, rounds);
+    for (size_t i=0; i<(size_t)fv->r->num_rows*rounds; ++i)
+    {
+        fv->r->storage[i] = (int)(((unsigned)rand_r(&seed) << 16) ^ (unsigned)rand_r(&seed));
+    }
+    fv->y = alloc_matrix(b->num_rows, rounds);
+
+    verify_args *vargs = make_verify_args(NULL, b, NULL, fv, num_threads);
+    run_threads(project_main, vargs, num_threads);
+    free(vargs);
+
+    return fv;
+}
+
+long freivalds_check_rows(freivalds_vectors *fv, matrix *a_rows, matrix *c_rows)
+{
+    matrix *diff = alloc_matrix(a_rows->num_rows, fv->r->num_cols);
+    gemm(GEMM_NO_TRANS, GEMM_NO_TRANS, 1, a_rows, fv->y, 0, diff);
+    gemm(GEMM_NO_TRANS, GEMM_NO_TRANS, -1, c_rows, fv->r, 1, diff);
+
+    long mismatches = 0;
+    for (size_t i=0; i<(size_t)diff->num_rows*diff->num_cols; ++i)
+    {
+        mismatches += diff->storage[i] != 0;
+    }
+    free_matrix(diff);
+    return mismatches;
+}
+
+void free_freivalds_vectors(freivalds_vectors *fv)
+{
+    free_matrix(fv->r);
+    free_matrix(fv->y);
+    free(fv);
+}
+
+int freivalds_verify(matrix *a, matrix *b, matrix *c, int rounds,
+                     int num_threads, unsigned int seed)
+{
+    if (a->num_cols != b->num_rows || c->num_rows != a->num_rows || c->num_cols != b->num_cols)
+    {
+        return 0;
+    }
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    freivalds_vectors *fv = freivalds_prepare(b, rounds, num_threads, seed);
+
+    verify_args *vargs = make_verify_args(a, b, c, fv, num_threads);
+    run_threads(compare_main, vargs, num_threads);
+
+    long mismatches = 0;
+    for (int i=0; i<num_threads; ++i)
+    {
+        mismatches += vargs[i].mismatches;
+    }
+
+    free(vargs);
+    free_freivalds_vectors(fv);
+    return mismatches == 0;
+}
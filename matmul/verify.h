@@ -0,0 +1,34 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "matrix.h"
+
+#define FREIVALDS_DEFAULT_ROUNDS 10
+
+// Freivalds' check that c == a * b: for random vectors r, a * (b * r) must
+// equal c * r.  Each round costs O(n^2) instead of the O(n^3) of
+// recomputing the product.  A correct c always passes; a wrong one passes
+// a round with probability at most 1/2, and usually far less, so it slips
+// through all rounds with probability at most 2^-rounds.  The arithmetic
+// wraps like multiply_matrix, so the check is exact modulo 2^32.
+//
+// Returns 1 if c passed every round.
+int freivalds_verify(matrix *a, matrix *b, matrix *c, int rounds,
+                     int num_threads, unsigned int seed);
+
+// The same check split in two, for results produced a block of rows at a
+// time: freivalds_prepare draws the random vectors and computes b * r once,
+// then freivalds_check_rows checks rows of c against the same rows of a
+// and returns how many entries of c * r differ.
+typedef struct _freivalds_vectors
+{
+    matrix *r;          // b->num_cols x rounds, round t in column t
+    matrix *y;          // b * r
+} freivalds_vectors;
+
+freivalds_vectors *freivalds_prepare(matrix *b, int rounds, int num_threads,
+                                     unsigned int seed);
+long freivalds_check_rows(freivalds_vectors *fv, matrix *a_rows, matrix *c_rows);
+void free_freivalds_vectors(freivalds_vectors *fv);
+
+#endif